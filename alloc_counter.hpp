@@ -0,0 +1,255 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <new>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Counts every call to the global operator new and delete, and the bytes
+// asked for, so a frame can check that it left the heap alone. This replaces
+// the program's operator new and delete: include it from exactly one
+// translation unit.
+std::atomic<unsigned long> heapAllocations{0};
+std::atomic<unsigned long> heapFrees{0};
+std::atomic<unsigned long> heapBytes{0};
+
+struct AllocCounts {
+	unsigned long allocations = 0, frees = 0, bytes = 0;
+
+	static AllocCounts now() {
+		return {heapAllocations.load(std::memory_order_relaxed), heapFrees.load(std::memory_order_relaxed),
+		        heapBytes.load(std::memory_order_relaxed)};
+	}
+
+	AllocCounts operator-(const AllocCounts& before) const {
+		return {allocations - before.allocations, frees - before.frees, bytes - before.bytes};
+	}
+};
+
+// Where allocations come from, while enabled: every operator new takes a
+// backtrace and adds its size to that call stack's entry in a fixed table,
+// so recording never allocates itself. Costs a few microseconds per
+// allocation, so it is only on for --debug-allocations. clear() empties the
+// table, e.g. at the start of each frame.
+class AllocSites {
+public:
+	static const int maxDepth = 10;
+
+	struct Site {
+		void *frames[maxDepth];
+		int depth;
+		unsigned long count, bytes;
+	};
+
+	bool enabled() const {
+		return on.load(std::memory_order_relaxed);
+	}
+
+	void setEnabled(bool enable) {
+		if (enable) {
+			// The first backtrace() loads the unwinder; not from operator new
+			void *frames[1];
+			backtrace(frames, 1);
+		}
+		on.store(enable, std::memory_order_relaxed);
+	}
+
+	void record(std::size_t size) {
+		static thread_local bool inside = false;
+		if (inside) {
+			return;
+		}
+		inside = true;
+		Site site = {};
+		site.depth = backtrace(site.frames, maxDepth);
+		std::uint64_t hash = 14695981039346656037ull;
+		for (int i = 0; i < site.depth; ++i) {
+			hash = (hash ^ (std::uintptr_t) site.frames[i]) * 1099511628211ull;
+		}
+
+		lock();
+		std::size_t index = hash % slots;
+		for (std::size_t probe = 0; probe < slots; ++probe, index = (index + 1) % slots) {
+			Site& slot = table[index];
+			if (slot.count == 0) {
+				if (used == slots / 2) {
+					dropped++; // keep probes short
+					break;
+				}
+				slot = site;
+				usedSlots[used++] = index;
+			} else if (slot.depth != site.depth || memcmp(slot.frames, site.frames, site.depth * sizeof(void*))) {
+				continue;
+			}
+			slot.count++;
+			slot.bytes += size;
+			break;
+		}
+		unlock();
+		inside = false;
+	}
+
+	void clear() {
+		lock();
+		for (std::size_t i = 0; i < used; ++i) {
+			table[usedSlots[i]].count = 0;
+		}
+		used = 0;
+		dropped = 0;
+		unlock();
+	}
+
+	// The `n` busiest sites, one per line: count, bytes and the innermost
+	// frames outside the allocator and the standard library
+	void print(std::ostream& out, std::size_t n, const char *indent = "  ") {
+		bool wasOn = enabled();
+		on.store(false, std::memory_order_relaxed);
+		std::vector<Site> sites;
+		lock();
+		for (std::size_t i = 0; i < used; ++i) {
+			sites.push_back(table[usedSlots[i]]);
+		}
+		unsigned long lost = dropped;
+		unlock();
+		std::sort(sites.begin(), sites.end(), [](const Site& a, const Site& b) { return a.count > b.count; });
+		for (std::size_t i = 0; i < std::min(n, sites.size()); ++i) {
+			out << indent << sites[i].count << " x, " << sites[i].bytes << " bytes: " << describe(sites[i]) << std::endl;
+		}
+		if (lost) {
+			out << indent << lost << " allocations at untracked sites (table full)" << std::endl;
+		}
+		on.store(wasOn, std::memory_order_relaxed);
+	}
+
+	// "loadPurchases(sqlite3*)+0x8c <- main+0x1f3a [main+0x4b7e2]"; the
+	// bracketed module offset is for addr2line -f -C -i -e <module>
+	static std::string describe(const Site& site) {
+		// Past operator new, and past the library frames if there are others
+		int first = site.depth, caller = site.depth;
+		for (int i = 0; i < site.depth && caller == site.depth; ++i) {
+			Dl_info info;
+			if (dladdr(site.frames[i], &info)) {
+				std::string name = info.dli_sname ? demangle(info.dli_sname) : "";
+				if (first == site.depth && i > 0 && name.rfind("operator new", 0) != 0) {
+					first = i;
+				}
+				if (!isLibrary(info, name)) {
+					caller = i;
+				}
+			}
+		}
+
+		std::string text;
+		int shown = 0;
+		for (int i = caller < site.depth ? caller : first; i < site.depth && shown < 3; ++i) {
+			Dl_info info;
+			if (!dladdr(site.frames[i], &info)) {
+				continue;
+			}
+			std::string name = info.dli_sname ? demangle(info.dli_sname) : "";
+			char offset[64];
+			std::uintptr_t address = (std::uintptr_t) site.frames[i];
+			if (info.dli_sname) {
+				snprintf(offset, sizeof(offset), "+0x%zx", (std::size_t) (address - (std::uintptr_t) info.dli_saddr));
+			} else {
+				name = "?";
+				offset[0] = 0;
+			}
+			text += (shown ? " <- " : "") + name + offset;
+			if (shown == 0) {
+				const char *module = info.dli_fname ? strrchr(info.dli_fname, '/') : nullptr;
+				snprintf(offset, sizeof(offset), " [%s+0x%zx]", module ? module + 1 : "?",
+				         (std::size_t) (address - (std::uintptr_t) info.dli_fbase));
+				text += offset;
+			}
+			shown++;
+		}
+		return shown ? text : "?";
+	}
+
+private:
+	static const std::size_t slots = 8192;
+
+	static std::string demangle(const char *symbol) {
+		int status;
+		char *plain = abi::__cxa_demangle(symbol, nullptr, nullptr, &status);
+		std::string name = status == 0 ? plain : symbol;
+		free(plain);
+		return name;
+	}
+
+	// operator new itself, this class, or std:: code (vector growth, string
+	// copies): the interesting frame is whoever called into them
+	static bool isLibrary(const Dl_info& info, const std::string& name) {
+		if (info.dli_fname && (strstr(info.dli_fname, "libstdc++") || strstr(info.dli_fname, "libc.so"))) {
+			return true;
+		}
+		if (name.empty() || name.rfind("operator new", 0) == 0) {
+			return true;
+		}
+		std::string head = name.substr(0, name.find('('));
+		// Template instances may start with their return type
+		std::size_t space = head.find(' ');
+		std::string qualified = space != std::string::npos && head.compare(0, 5, "std::") ? head.substr(space + 1) : head;
+		return qualified.rfind("AllocSites::", 0) == 0 || qualified.rfind("std::", 0) == 0 ||
+			qualified.rfind("__gnu_cxx::", 0) == 0;
+	}
+
+	void lock() {
+		while (busy.test_and_set(std::memory_order_acquire)) {}
+	}
+
+	void unlock() {
+		busy.clear(std::memory_order_release);
+	}
+
+	std::atomic<bool> on{false};
+	std::atomic_flag busy = ATOMIC_FLAG_INIT;
+	Site table[slots] = {};
+	std::size_t usedSlots[slots / 2] = {};
+	std::size_t used = 0;
+	unsigned long dropped = 0;
+};
+
+// Constant-initialized: operator new may run before any constructor does
+constinit AllocSites allocSites;
+
+void* operator new(std::size_t size) {
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	heapBytes.fetch_add(size, std::memory_order_relaxed);
+	if (allocSites.enabled()) {
+		allocSites.record(size);
+	}
+	if (void *p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+// GCC sees std::free() given a pointer that came from operator new, not
+// knowing the operator new above got it from std::malloc()
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *p) noexcept {
+	if (p) {
+		heapFrees.fetch_add(1, std::memory_order_relaxed);
+	}
+	std::free(p);
+}
+#pragma GCC diagnostic pop
+
+void operator delete(void *p, std::size_t) noexcept {
+	operator delete(p);
+}
+
+#endif // ALLOC_COUNTER_HPP
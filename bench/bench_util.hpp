@@ -0,0 +1,46 @@
+#ifndef BENCH_UTIL_HPP
+#define BENCH_UTIL_HPP
+
+// Helpers the benchmarks in bench/ share
+
+#include "helpers.hpp"
+
+double elapsedMs(chrono::steady_clock::time_point since) {
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - since).count();
+}
+
+// Nearest-rank percentile `p` (0-100) of the samples, 0 if there are none
+template <typename T>
+double percentile(vector<T> samples, double p) {
+	if (samples.empty()) {
+		return 0;
+	}
+	sort(samples.begin(), samples.end());
+	size_t rank = (size_t) (p / 100.0 * (samples.size() - 1) + 0.5);
+	return samples[min(rank, samples.size() - 1)];
+}
+
+// Rows in the purchases table, or -1 if it can't be read
+long countRows(sqlite3 *db) {
+	sqlite3_stmt *stmt;
+	long rows = -1;
+	if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM purchases;", -1, &stmt, nullptr) == SQLITE_OK &&
+		sqlite3_step(stmt) == SQLITE_ROW) {
+		rows = (long) sqlite3_column_int64(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	return rows;
+}
+
+// "1000,10000" -> {1000, 10000}
+vector<long> parseSizes(const char *list) {
+	vector<long> sizes;
+	stringstream ss(list);
+	string size;
+	while (getline(ss, size, ',')) {
+		sizes.push_back(atol(size.c_str()));
+	}
+	return sizes;
+}
+
+#endif // BENCH_UTIL_HPP
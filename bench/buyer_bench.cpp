@@ -0,0 +1,151 @@
+// Data layer benchmark: times the helpers.hpp queries against databases of
+// increasing size, so a change that scales badly shows up before it ships.
+//
+//   buyer_bench [--sizes 1000,100000,1000000,10000000] [--dir DIR] [--seconds S]
+//
+// Each size gets its own database in DIR (default "."), generated once by
+// purchase_generator.hpp with its default options and reused by later runs.
+// Every operation is repeated for about S seconds (at least 3 times) and
+// reported as JSON on stdout: median and p99 latency, plus rows/sec, which is
+// rows written for insert / deletePurchase, rows returned for loadPurchases
+// and rows in the table for the queries. deletePurchase removes exactly the
+// rows insert added, so the database is left as it was generated.
+// allocs_per_call and bytes_per_call count the heap allocations (operator
+// new) one call makes.
+
+#include <cstring>
+
+#include "bench_util.hpp"
+#include "purchase_generator.hpp"
+#include "alloc_counter.hpp"
+
+struct Measurement {
+	string name;
+	long rows = 0;
+	vector<float> latencyMs;
+	double rowsPerCall = 1;
+	AllocCounts heap; // over all calls
+};
+
+// Runs call() for about `seconds`, at least three times
+template <typename F>
+Measurement measure(const string& name, long rows, double seconds, F call) {
+	Measurement m;
+	m.name = name;
+	m.rows = rows;
+	auto start = chrono::steady_clock::now();
+	while (m.latencyMs.size() < 3 || elapsedMs(start) < seconds * 1000) {
+		AllocCounts heapBefore = AllocCounts::now();
+		auto t0 = chrono::steady_clock::now();
+		call();
+		AllocCounts used = AllocCounts::now() - heapBefore;
+		m.latencyMs.push_back((float) elapsedMs(t0));
+		m.heap.allocations += used.allocations;
+		m.heap.bytes += used.bytes;
+	}
+	return m;
+}
+
+void printJson(const vector<Measurement>& results) {
+	cout << "{\"benchmarks\": [" << endl;
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Measurement& m = results[i];
+		double median = percentile(m.latencyMs, 50);
+		cout << fixed << setprecision(4)
+			 << "  {\"name\": \"" << m.name << "\", \"rows\": " << m.rows
+			 << ", \"samples\": " << m.latencyMs.size()
+			 << ", \"median_ms\": " << median
+			 << ", \"p99_ms\": " << percentile(m.latencyMs, 99)
+			 << ", \"rows_per_sec\": " << setprecision(0) << (median > 0 ? m.rowsPerCall * 1000 / median : 0)
+			 << ", \"allocs_per_call\": " << setprecision(1) << (double) m.heap.allocations / m.latencyMs.size()
+			 << ", \"bytes_per_call\": " << setprecision(0) << (double) m.heap.bytes / m.latencyMs.size()
+			 << "}" << (i + 1 < results.size() ? "," : "") << endl;
+	}
+	cout << "]}" << endl;
+}
+
+int main(int argc, char **argv) {
+	vector<long> sizes = {1000, 100000, 1000000, 10000000};
+	string dir = ".";
+	double seconds = 1;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "--sizes")) sizes = parseSizes(argv[i + 1]);
+		else if (!strcmp(argv[i], "--dir")) dir = argv[i + 1];
+		else if (!strcmp(argv[i], "--seconds")) seconds = atof(argv[i + 1]);
+		else {
+			cerr << "Unknown option " << argv[i] << endl;
+			return 1;
+		}
+	}
+
+	vector<Measurement> results;
+	for (long rows : sizes) {
+		string path = dir + "/bench_" + to_string(rows) + ".db";
+		sqlite3 *db;
+		if (openDatabase(path.c_str(), &db)) {
+			cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
+			return 1;
+		}
+		createSchema(db);
+		GeneratorOptions options;
+		options.rows = rows;
+		if (countRows(db) != rows) {
+			cerr << "Generating " << rows << " rows in " << path << endl;
+			auto t0 = chrono::steady_clock::now();
+			runCommand(db, "DELETE FROM purchases;");
+			if (!generatePurchases(db, options)) {
+				cerr << "Can't generate purchases" << endl;
+				return 1;
+			}
+			cerr << "  took " << fixed << setprecision(1) << elapsedMs(t0) / 1000 << " s" << endl;
+		}
+		cerr << "Benchmarking " << rows << " rows" << endl;
+
+		const string item = PurchaseGenerator(options).itemName(0);
+		vector<int> inserted;
+		results.push_back(measure("insert", rows, seconds, [&] {
+			// No type, so it is looked up from earlier purchases as in the app
+			insert(db, item, 1, 2.5);
+			inserted.push_back((int) sqlite3_last_insert_rowid(db));
+		}));
+		Measurement deletes;
+		deletes.name = "deletePurchase";
+		deletes.rows = rows;
+		for (int id : inserted) {
+			auto t0 = chrono::steady_clock::now();
+			deletePurchase(db, id);
+			deletes.latencyMs.push_back((float) elapsedMs(t0));
+		}
+		results.push_back(deletes);
+
+		results.push_back(measure("getTotalSpent(item, days)", rows, seconds, [&] { getTotalSpent(db, item, 30); }));
+		results.push_back(measure("getTotalSpent(days)", rows, seconds, [&] { getTotalSpent(db, 30); }));
+		results.push_back(measure("getTotalSpent()", rows, seconds, [&] { getTotalSpent(db); }));
+		results.push_back(measure("getAveragePrice", rows, seconds, [&] { getAveragePrice(db, item, 30); }));
+		for (size_t i = results.size() - 4; i < results.size(); ++i) {
+			results[i].rowsPerCall = rows;
+		}
+
+		size_t loaded = 0;
+		results.push_back(measure("loadPurchases", rows, seconds, [&] { loaded = loadPurchases(db).size(); }));
+		results.back().rowsPerCall = loaded;
+
+		// Growing prefixes of the most popular name, then one nothing matches
+		vector<string> prefixes;
+		for (size_t length = 1; length <= item.size(); length *= 2) {
+			prefixes.push_back(item.substr(0, length));
+		}
+		prefixes.push_back("zzz");
+		size_t prefix = 0;
+		results.push_back(measure("getNameSuggestions", rows, seconds, [&] {
+			getNameSuggestions(db, prefixes[prefix++ % prefixes.size()]);
+		}));
+		results.back().rowsPerCall = rows;
+
+		sqlite3_close(db);
+	}
+
+	printJson(results);
+	return 0;
+}
@@ -0,0 +1,98 @@
+// Writes a synthetic purchase history for benchmarks and UI stress tests.
+//
+//   buyer_gen [--out data.db] [--rows N] [--days D] [--end YYYY-MM-DD] [--items N]
+//             [--zipf S] [--basket N] [--drift R] [--duplicates P]
+//             [--types food:55,drink:20,...] [--seed N]
+//
+// The same options (including --end, which defaults to today) always produce
+// the same rows; see purchase_generator.hpp for what they shape. The output
+// database must not exist yet, so a real data.db is never touched by mistake.
+
+#include <filesystem>
+
+#include "purchase_generator.hpp"
+
+// Days since 1970-01-01 (Hinnant's days_from_civil), or -1 if malformed
+long parseDay(const char *date) {
+	int y, m, d;
+	if (sscanf(date, "%d-%d-%d", &y, &m, &d) != 3 || m < 1 || m > 12 || d < 1 || d > 31) {
+		return -1;
+	}
+	y -= m <= 2;
+	long era = (y >= 0 ? y : y - 399) / 400;
+	long yoe = y - era * 400;
+	long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+// "food:55,drink:20" -> {{"food", 55}, {"drink", 20}}
+bool parseTypes(const char *list, vector<pair<string, double>>& types) {
+	types.clear();
+	stringstream ss(list);
+	string entry;
+	while (getline(ss, entry, ',')) {
+		size_t colon = entry.find(':');
+		if (colon == string::npos || colon == 0 || atof(entry.c_str() + colon + 1) <= 0) {
+			return false;
+		}
+		types.push_back({entry.substr(0, colon), atof(entry.c_str() + colon + 1)});
+	}
+	return !types.empty();
+}
+
+int main(int argc, char **argv) {
+	const char *path = "data.db";
+	GeneratorOptions options;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "--out")) path = argv[i + 1];
+		else if (!strcmp(argv[i], "--rows")) options.rows = atol(argv[i + 1]);
+		else if (!strcmp(argv[i], "--days")) options.days = max(atoi(argv[i + 1]), 1);
+		else if (!strcmp(argv[i], "--items")) options.items = max(atoi(argv[i + 1]), 1);
+		else if (!strcmp(argv[i], "--zipf")) options.zipf = atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "--basket")) options.basket = atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "--drift")) options.priceDrift = atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "--duplicates")) options.duplicates = atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "--seed")) options.seed = strtoull(argv[i + 1], nullptr, 10);
+		else if (!strcmp(argv[i], "--end")) {
+			options.endDay = parseDay(argv[i + 1]);
+			if (options.endDay < 0) {
+				cerr << "Expected --end YYYY-MM-DD" << endl;
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--types")) {
+			if (!parseTypes(argv[i + 1], options.typeMix)) {
+				cerr << "Expected --types name:weight,..." << endl;
+				return 1;
+			}
+		}
+		else {
+			cerr << "Unknown option " << argv[i] << endl;
+			return 1;
+		}
+	}
+
+	if (filesystem::exists(path)) {
+		cerr << path << " already exists" << endl;
+		return 1;
+	}
+	sqlite3 *db;
+	if (openDatabase(path, &db)) {
+		cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
+		return 1;
+	}
+
+	auto start = chrono::steady_clock::now();
+	if (!generatePurchases(db, options)) {
+		cerr << "Can't generate purchases" << endl;
+		return 1;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	sqlite3_close(db);
+
+	cout << fixed << setprecision(2) << "wrote " << options.rows << " purchases to " << path
+		 << " in " << seconds << " s (" << setprecision(0) << options.rows / seconds << " rows/s)" << endl;
+	return 0;
+}
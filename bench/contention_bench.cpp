@@ -0,0 +1,257 @@
+// Contention benchmark: N writer processes and a GUI hammer the same database.
+//
+//   buyer_contention [--db PATH] [--writers N] [--seconds S] [--batch K] [--gui PATH]
+//                    [--rows N]
+//
+// Each writer commits batches of K inserts with BEGIN IMMEDIATE, retrying on
+// lock contention the same way the app does. A reader process replays the
+// queries the GUI issues every frame at 60 Hz; with --gui the real app binary
+// is started in the current directory as well (point --db at its data.db).
+// --rows N first fills an empty database with N generated purchases, so the
+// frame queries run against a realistic history.
+// Reports write throughput and commit / frame latency percentiles.
+
+#include <csignal>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench_util.hpp"
+#include "purchase_generator.hpp"
+
+struct Result {
+	long transactions = 0;
+	long rows = 0;
+	long failures = 0;
+	vector<float> latencyMs;
+};
+
+void writeResult(int fd, const Result& r) {
+	long header[4] = {r.transactions, r.rows, r.failures, (long) r.latencyMs.size()};
+	if (write(fd, header, sizeof(header)) < 0 ||
+		write(fd, r.latencyMs.data(), r.latencyMs.size() * sizeof(float)) < 0) {
+		perror("write");
+	}
+}
+
+bool readAll(int fd, void *out, size_t size) {
+	char *p = static_cast<char*>(out);
+	while (size > 0) {
+		ssize_t n = read(fd, p, size);
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool readResult(int fd, Result& r) {
+	long header[4];
+	if (!readAll(fd, header, sizeof(header))) {
+		return false;
+	}
+	r.transactions += header[0];
+	r.rows += header[1];
+	r.failures += header[2];
+	size_t offset = r.latencyMs.size();
+	r.latencyMs.resize(offset + header[3]);
+	return readAll(fd, r.latencyMs.data() + offset, header[3] * sizeof(float));
+}
+
+Result runWriter(const char *path, int id, int batch, double seconds) {
+	Result r;
+	sqlite3 *db;
+	if (openDatabase(path, &db)) {
+		cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
+		exit(1);
+	}
+
+	Purchase p = {0, "writer" + to_string(id), 1, 1.5, "", "bench"};
+	auto statements = make_unique<PurchaseStatements>(db);
+	auto start = chrono::steady_clock::now();
+	while (elapsedMs(start) < seconds * 1000) {
+		auto t0 = chrono::steady_clock::now();
+		int rc = retryBusy([&] {
+			int result = sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+			for (int i = 0; i < batch && result == SQLITE_OK; ++i) {
+				p.timeStamp = getTimeStamp();
+				result = statements->insert(p);
+			}
+			if (result == SQLITE_OK) {
+				result = sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+			}
+			if (result != SQLITE_OK) {
+				sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+			}
+			return result;
+		}, 20);
+		r.latencyMs.push_back((float) elapsedMs(t0));
+
+		if (rc == SQLITE_OK) {
+			r.transactions++;
+			r.rows += batch;
+		} else {
+			r.failures++;
+		}
+	}
+
+	statements.reset(); // finalized before the connection closes
+	sqlite3_close(db);
+	return r;
+}
+
+// The queries one GUI frame runs, paced at 60 Hz
+Result runFrameReader(const char *path, double seconds) {
+	Result r;
+	sqlite3 *db;
+	if (openDatabase(path, &db)) {
+		cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
+		exit(1);
+	}
+
+	auto start = chrono::steady_clock::now();
+	while (elapsedMs(start) < seconds * 1000) {
+		auto t0 = chrono::steady_clock::now();
+		vector<Purchase> purchases = loadPurchases(db);
+		getTotalSpent(db);
+		getTotalSpent(db, 30);
+		getAverageSpentPerDayLastMonth(db);
+		double ms = elapsedMs(t0);
+		r.latencyMs.push_back((float) ms);
+		r.transactions++;
+		r.rows += purchases.size();
+
+		if (ms < 1000.0 / 60) {
+			this_thread::sleep_for(chrono::duration<double, milli>(1000.0 / 60 - ms));
+		}
+	}
+
+	sqlite3_close(db);
+	return r;
+}
+
+template <typename F>
+pid_t spawn(int& readFd, F body) {
+	int fds[2];
+	if (pipe(fds)) {
+		perror("pipe");
+		exit(1);
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		writeResult(fds[1], body());
+		close(fds[1]);
+		_exit(0);
+	}
+	close(fds[1]);
+	readFd = fds[0];
+	return pid;
+}
+
+bool isEmpty(sqlite3 *db) {
+	sqlite3_stmt *stmt;
+	bool empty = true;
+	if (sqlite3_prepare_v2(db, "SELECT 1 FROM purchases LIMIT 1;", -1, &stmt, nullptr) == SQLITE_OK) {
+		empty = sqlite3_step(stmt) != SQLITE_ROW;
+	}
+	sqlite3_finalize(stmt);
+	return empty;
+}
+
+void printLatency(const char *label, const Result& r) {
+	cout << fixed << setprecision(2) << label
+		 << "p50 " << percentile(r.latencyMs, 50)
+		 << "  p99 " << percentile(r.latencyMs, 99)
+		 << "  p99.9 " << percentile(r.latencyMs, 99.9)
+		 << "  max " << percentile(r.latencyMs, 100) << endl;
+}
+
+int main(int argc, char **argv) {
+	const char *path = "contention.db";
+	const char *gui = nullptr;
+	int writers = 4;
+	int batch = 10;
+	double seconds = 5;
+	long rows = 0;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "--db")) path = argv[i + 1];
+		else if (!strcmp(argv[i], "--writers")) writers = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--batch")) batch = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--seconds")) seconds = atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "--gui")) gui = argv[i + 1];
+		else if (!strcmp(argv[i], "--rows")) rows = atol(argv[i + 1]);
+		else {
+			cerr << "Unknown option " << argv[i] << endl;
+			return 1;
+		}
+	}
+
+	sqlite3 *db;
+	if (openDatabase(path, &db)) {
+		cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
+		return 1;
+	}
+	createSchema(db);
+	if (rows > 0 && isEmpty(db)) {
+		GeneratorOptions options;
+		options.rows = rows;
+		if (!generatePurchases(db, options)) {
+			cerr << "Can't generate purchases" << endl;
+			return 1;
+		}
+	}
+	sqlite3_close(db);
+
+	pid_t guiPid = 0;
+	if (gui) {
+		guiPid = fork();
+		if (guiPid == 0) {
+			execl(gui, gui, (char*) nullptr);
+			perror("execl");
+			_exit(1);
+		}
+	}
+
+	vector<int> writerFds(writers);
+	vector<pid_t> pids;
+	for (int i = 0; i < writers; ++i) {
+		pids.push_back(spawn(writerFds[i], [&] { return runWriter(path, i, batch, seconds); }));
+	}
+	int readerFd;
+	pids.push_back(spawn(readerFd, [&] { return runFrameReader(path, seconds); }));
+
+	Result written, frames;
+	for (int fd : writerFds) {
+		if (!readResult(fd, written)) {
+			cerr << "A writer process died" << endl;
+		}
+		close(fd);
+	}
+	if (!readResult(readerFd, frames)) {
+		cerr << "The frame reader process died" << endl;
+	}
+	close(readerFd);
+	for (pid_t pid : pids) {
+		waitpid(pid, nullptr, 0);
+	}
+	if (guiPid > 0) {
+		kill(guiPid, SIGTERM);
+		waitpid(guiPid, nullptr, 0);
+	}
+
+	cout << "writers " << writers << ", batch " << batch << ", " << seconds << " s"
+		 << (gui ? ", with GUI" : "") << endl;
+	cout << fixed << setprecision(1)
+		 << "commits            : " << written.transactions << " (" << written.transactions / seconds << "/s), "
+		 << written.failures << " failed" << endl
+		 << "rows               : " << written.rows << " (" << written.rows / seconds << "/s)" << endl;
+	printLatency("commit latency ms  : ", written);
+	cout << "frames             : " << frames.transactions << " (" << frames.transactions / seconds << "/s)" << endl;
+	printLatency("frame queries ms   : ", frames);
+
+	return written.failures ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+// Memory scaling benchmark: how many bytes each purchase costs once the list
+// is loaded, from 1k to 10M rows, so a change that fattens a row shows up
+// before it ships.
+//
+//   buyer_memory [--sizes 1000,10000,100000,1000000,10000000] [--dir DIR]
+//                [--baseline FILE] [--tolerance 0.1] [--update-baseline 1]
+//
+// Databases are the bench_<rows>.db files buyer_bench uses, generated the
+// same way when missing. Every size is measured in a process of its own,
+// which streams the list into a PurchaseTable the way PurchaseLoader does.
+// It reports the RSS growth over the load, the RSS peak, SQLite's memory high
+// water and the table's own byte counts, per purchase. The results are JSON
+// on stdout, with a chart of bytes per purchase on stderr.
+//
+// With --baseline, the first run writes FILE. Later runs exit 1 if some size
+// needs more than `tolerance` (10%) more bytes per purchase than FILE says,
+// counting either the table or, from 100k rows up, the RSS growth; below
+// that, pages and the allocator's arenas swamp it. --update-baseline 1
+// rewrites FILE instead.
+
+#include <cstring>
+#include <fstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench_util.hpp"
+#include "purchase_generator.hpp"
+#include "purchase_loader.hpp"
+
+struct Footprint {
+	long rows = 0;
+	size_t rssGrowth = 0, peakRss = 0;
+	sqlite3_int64 sqlitePeak = 0;
+	PurchaseTable::Footprint table = {};
+
+	double rssPerRow() const {
+		return rows ? (double) rssGrowth / rows : 0;
+	}
+
+	double tablePerRow() const {
+		return rows ? (double) table.total() / rows : 0;
+	}
+};
+
+// Loads `path` in a child process, so each size starts from a fresh heap
+bool measure(const string& path, Footprint& result) {
+	int fds[2];
+	if (pipe(fds)) {
+		return false;
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		Footprint f;
+		sqlite3 *db;
+		if (openDatabase(path.c_str(), &db) == SQLITE_OK) {
+			ProcessMemory before = ProcessMemory::now();
+			PurchaseTable table;
+			PurchaseStream stream = streamPurchases(db, 64);
+			while (stream.next()) {
+				for (const Purchase& p : stream.chunk()) {
+					table.append(p);
+				}
+			}
+			table.finishAppending();
+			stream.reset();
+			ProcessMemory after = ProcessMemory::now();
+
+			f.rows = (long) table.size();
+			f.rssGrowth = after.rss > before.rss ? after.rss - before.rss : 0;
+			f.peakRss = after.peakRss;
+			f.sqlitePeak = SqliteMemory::now().peak;
+			f.table = table.footprint();
+		}
+		bool written = write(fds[1], &f, sizeof(f)) == (ssize_t) sizeof(f);
+		_exit(written && f.rows ? 0 : 1);
+	}
+	close(fds[1]);
+	if (pid < 0) {
+		close(fds[0]);
+		return false;
+	}
+	bool read = ::read(fds[0], &result, sizeof(result)) == (ssize_t) sizeof(result);
+	close(fds[0]);
+	int status;
+	waitpid(pid, &status, 0);
+	return read && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void printJson(const vector<Footprint>& results) {
+	cout << "{\"memory\": [" << endl;
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Footprint& f = results[i];
+		cout << fixed << setprecision(1)
+			 << "  {\"rows\": " << f.rows
+			 << ", \"rss_bytes_per_purchase\": " << f.rssPerRow()
+			 << ", \"table_bytes_per_purchase\": " << f.tablePerRow()
+			 << ", \"purchase_structs\": " << f.table.purchases << ", \"purchase_strings\": " << f.table.strings
+			 << ", \"cell_offsets\": " << f.table.cells << ", \"cell_text\": " << f.table.text
+			 << ", \"peak_rss\": " << f.peakRss << ", \"sqlite_high_water\": " << f.sqlitePeak
+			 << "}" << (i + 1 < results.size() ? "," : "") << endl;
+	}
+	cout << "]}" << endl;
+}
+
+// Bars of RSS bytes per purchase, with the table's share marked by '#'
+void printChart(const vector<Footprint>& results) {
+	double widest = 1;
+	for (const Footprint& f : results) {
+		widest = max({widest, f.rssPerRow(), f.tablePerRow()});
+	}
+	cerr << "Bytes per purchase (# table, = rest of the RSS growth)" << endl;
+	for (const Footprint& f : results) {
+		int table = (int) (f.tablePerRow() / widest * 60 + 0.5);
+		int rss = max((int) (f.rssPerRow() / widest * 60 + 0.5), table);
+		cerr << setw(10) << f.rows << " " << string(table, '#') << string(rss - table, '=') << " "
+			 << fixed << setprecision(0) << f.rssPerRow() << " / " << f.tablePerRow() << endl;
+	}
+}
+
+// "rows rss_per_purchase table_per_purchase" lines
+map<long, pair<double, double>> readBaseline(const string& path) {
+	map<long, pair<double, double>> baseline;
+	ifstream in(path);
+	long rows;
+	double rss, table;
+	while (in >> rows >> rss >> table) {
+		baseline[rows] = {rss, table};
+	}
+	return baseline;
+}
+
+bool writeBaseline(const string& path, const vector<Footprint>& results) {
+	ofstream out(path);
+	out << fixed << setprecision(1);
+	for (const Footprint& f : results) {
+		out << f.rows << " " << f.rssPerRow() << " " << f.tablePerRow() << "\n";
+	}
+	return (bool) out;
+}
+
+int main(int argc, char **argv) {
+	vector<long> sizes = {1000, 10000, 100000, 1000000, 10000000};
+	string dir = ".";
+	string baselinePath;
+	double tolerance = 0.1;
+	bool updateBaseline = false;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "--sizes")) sizes = parseSizes(argv[i + 1]);
+		else if (!strcmp(argv[i], "--dir")) dir = argv[i + 1];
+		else if (!strcmp(argv[i], "--baseline")) baselinePath = argv[i + 1];
+		else if (!strcmp(argv[i], "--tolerance")) tolerance = atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "--update-baseline")) updateBaseline = atoi(argv[i + 1]);
+		else {
+			cerr << "Unknown option " << argv[i] << endl;
+			return 1;
+		}
+	}
+
+	vector<Footprint> results;
+	for (long rows : sizes) {
+		string path = dir + "/bench_" + to_string(rows) + ".db";
+		sqlite3 *db;
+		if (openDatabase(path.c_str(), &db)) {
+			cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
+			return 1;
+		}
+		createSchema(db);
+		if (countRows(db) != rows) {
+			cerr << "Generating " << rows << " rows in " << path << endl;
+			GeneratorOptions options;
+			options.rows = rows;
+			runCommand(db, "DELETE FROM purchases;");
+			if (!generatePurchases(db, options)) {
+				cerr << "Can't generate purchases" << endl;
+				return 1;
+			}
+		}
+		sqlite3_close(db);
+
+		cerr << "Loading " << rows << " rows" << endl;
+		Footprint f;
+		if (!measure(path, f)) {
+			cerr << "Can't load " << path << endl;
+			return 1;
+		}
+		results.push_back(f);
+	}
+
+	printJson(results);
+	printChart(results);
+
+	if (baselinePath.empty()) {
+		return 0;
+	}
+	map<long, pair<double, double>> baseline = readBaseline(baselinePath);
+	if (baseline.empty() || updateBaseline) {
+		if (!writeBaseline(baselinePath, results)) {
+			cerr << "Can't write " << baselinePath << endl;
+			return 1;
+		}
+		cerr << "Baseline written to " << baselinePath << endl;
+		return 0;
+	}
+	int regressions = 0;
+	for (const Footprint& f : results) {
+		auto it = baseline.find(f.rows);
+		if (it == baseline.end()) {
+			continue;
+		}
+		auto [rss, table] = it->second;
+		bool rssGrew = f.rows >= 100000 && f.rssPerRow() > rss * (1 + tolerance);
+		if (rssGrew || f.tablePerRow() > table * (1 + tolerance)) {
+			cerr << fixed << setprecision(1) << f.rows << " rows: " << f.rssPerRow() << " / " << f.tablePerRow()
+				 << " bytes per purchase, baseline " << rss << " / " << table << endl;
+			regressions++;
+		}
+	}
+	return regressions ? 1 : 0;
+}
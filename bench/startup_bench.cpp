@@ -0,0 +1,242 @@
+// Cold-start benchmark: launches the app headless against databases of
+// increasing size and times each launch to its first usable frame, the first
+// one that shows the whole purchase list.
+//
+//   buyer_startup [--app ./main] [--sizes 1000,100000,1000000] [--dir DIR] [--runs N]
+//                 [--warm 1] [--target-ms MS]
+//
+// Each size gets its own database in DIR (default "."), generated once by
+// purchase_generator.hpp and reused by later runs; an untimed first launch
+// moves its older years out into archives, as the app does on a real first
+// start. Before every launch the database and its archives are dropped from
+// the page cache (posix_fadvise), so SQLite reads them from disk as after a
+// reboot; --warm 1 leaves them cached. The binary and its libraries stay
+// cached either way.
+//
+// The app runs with --headless --startup-report --exit-after-startup. A
+// launch is timed from fork until its report arrives on the pipe, so exec,
+// dynamic loading and static initialization count too. Results are JSON on
+// stdout: time-to-first-frame percentiles per size, the app's own total, and
+// the median of every phase it reported. With --target-ms, exits 1 when the
+// p90 of some size misses the target.
+
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench_util.hpp"
+#include "purchase_generator.hpp"
+
+struct Launch {
+	double wallMs = 0;  // fork to report
+	double appMs = 0;   // what the app measured itself, from static initialization
+	long purchases = 0;
+	vector<pair<string, double>> phases;
+};
+
+struct SizeResult {
+	long rows = 0;
+	vector<Launch> launches;
+};
+
+// Drops the database named `prefix`, its -wal and -shm and its archives
+// (prefix-YEAR.db) from the page cache
+void evict(const string& dir, const string& prefix) {
+	for (const auto& entry : filesystem::directory_iterator(dir)) {
+		string name = entry.path().filename().string();
+		if (name.rfind(prefix + ".", 0) != 0 && name.rfind(prefix + "-", 0) != 0) {
+			continue;
+		}
+		int fd = open(entry.path().c_str(), O_RDONLY);
+		if (fd >= 0) {
+			fdatasync(fd); // dirty pages would stay
+			posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+			close(fd);
+		}
+	}
+}
+
+// "  font baking    2.82    55.50" -> "font baking", 2.82 ms, 55.50 ms
+// since launch; false for the other lines of the report
+bool parsePhase(const string& line, string& name, double& ms, double& sinceLaunch) {
+	istringstream words(line);
+	vector<string> tokens;
+	for (string token; words >> token; ) {
+		tokens.push_back(token);
+	}
+	if (tokens.size() < 3) {
+		return false;
+	}
+	char *end;
+	ms = strtod(tokens[tokens.size() - 2].c_str(), &end);
+	if (*end) {
+		return false;
+	}
+	sinceLaunch = strtod(tokens.back().c_str(), &end);
+	if (*end) {
+		return false;
+	}
+	name = tokens[0];
+	for (size_t i = 1; i + 2 < tokens.size(); ++i) {
+		name += " " + tokens[i];
+	}
+	return true;
+}
+
+bool launch(const string& app, const string& db, const string& dir, Launch& result) {
+	int fds[2];
+	if (pipe(fds)) {
+		return false;
+	}
+	auto start = chrono::steady_clock::now();
+	pid_t pid = fork();
+	if (pid == 0) {
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDERR_FILENO);
+		execl(app.c_str(), app.c_str(), "--headless", "--db", db.c_str(), "--archive-dir", dir.c_str(),
+		      "--startup-report", "--exit-after-startup", (char *) nullptr);
+		_exit(127);
+	}
+	close(fds[1]);
+	if (pid < 0) {
+		close(fds[0]);
+		return false;
+	}
+
+	// The report ends with "  N purchases loaded"
+	FILE *out = fdopen(fds[0], "r");
+	bool reported = false;
+	char buffer[256];
+	while (fgets(buffer, sizeof(buffer), out)) {
+		string line = buffer, name;
+		double ms, sinceLaunch;
+		if (line.find("purchases loaded") != string::npos) {
+			result.wallMs = elapsedMs(start);
+			result.purchases = atol(buffer);
+			reported = true;
+		} else if (parsePhase(line, name, ms, sinceLaunch)) {
+			result.phases.push_back({name, ms});
+			result.appMs = sinceLaunch;
+		}
+	}
+	fclose(out);
+	int status;
+	waitpid(pid, &status, 0);
+	return reported && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void printJson(const vector<SizeResult>& results, bool cold, double targetMs) {
+	cout << "{\"cold\": " << (cold ? "true" : "false") << ", \"startup\": [" << endl;
+	for (size_t i = 0; i < results.size(); ++i) {
+		const SizeResult& r = results[i];
+		vector<double> wall, app;
+		for (const Launch& l : r.launches) {
+			wall.push_back(l.wallMs);
+			app.push_back(l.appMs);
+		}
+		cout << fixed << setprecision(2)
+			 << "  {\"rows\": " << r.rows << ", \"purchases_loaded\": " << r.launches.front().purchases
+			 << ", \"runs\": " << r.launches.size()
+			 << ", \"p50_ms\": " << percentile(wall, 50) << ", \"p90_ms\": " << percentile(wall, 90)
+			 << ", \"p99_ms\": " << percentile(wall, 99) << ", \"max_ms\": " << percentile(wall, 100)
+			 << ", \"in_app_p50_ms\": " << percentile(app, 50);
+		if (targetMs > 0) {
+			cout << ", \"meets_target\": " << (percentile(wall, 90) <= targetMs ? "true" : "false");
+		}
+		cout << "," << endl << "   \"phases_p50_ms\": {";
+		const vector<pair<string, double>>& names = r.launches.front().phases;
+		for (size_t p = 0; p < names.size(); ++p) {
+			vector<double> times;
+			for (const Launch& l : r.launches) {
+				if (p < l.phases.size()) {
+					times.push_back(l.phases[p].second);
+				}
+			}
+			cout << (p ? ", " : "") << "\"" << names[p].first << "\": " << percentile(times, 50);
+		}
+		cout << "}}" << (i + 1 < results.size() ? "," : "") << endl;
+	}
+	cout << "]}" << endl;
+}
+
+int main(int argc, char **argv) {
+	string app = "./main";
+	vector<long> sizes = {1000, 100000, 1000000};
+	string dir = ".";
+	int runs = 20;
+	bool cold = true;
+	double targetMs = 0;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "--app")) app = argv[i + 1];
+		else if (!strcmp(argv[i], "--sizes")) sizes = parseSizes(argv[i + 1]);
+		else if (!strcmp(argv[i], "--dir")) dir = argv[i + 1];
+		else if (!strcmp(argv[i], "--runs")) runs = max(atoi(argv[i + 1]), 1);
+		else if (!strcmp(argv[i], "--warm")) cold = !atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--target-ms")) targetMs = atof(argv[i + 1]);
+		else {
+			cerr << "Unknown option " << argv[i] << endl;
+			return 1;
+		}
+	}
+
+	vector<SizeResult> results;
+	for (long rows : sizes) {
+		string prefix = "startup_" + to_string(rows);
+		string path = dir + "/" + prefix + ".db";
+		if (!filesystem::exists(path)) {
+			cerr << "Generating " << rows << " rows in " << path << endl;
+			sqlite3 *db;
+			if (openDatabase(path.c_str(), &db)) {
+				cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
+				return 1;
+			}
+			createSchema(db);
+			GeneratorOptions options;
+			options.rows = rows;
+			if (!generatePurchases(db, options)) {
+				cerr << "Can't generate purchases" << endl;
+				return 1;
+			}
+			sqlite3_close(db);
+		}
+
+		cerr << "Launching against " << rows << " rows" << endl;
+		SizeResult result;
+		result.rows = rows;
+		Launch first;
+		if (!launch(app, path, dir, first)) {
+			cerr << "Can't launch " << app << " headless" << endl;
+			return 1;
+		}
+		for (int run = 0; run < runs; ++run) {
+			if (cold) {
+				evict(dir, prefix);
+			}
+			Launch l;
+			if (!launch(app, path, dir, l)) {
+				cerr << "Launch " << run + 1 << " failed" << endl;
+				return 1;
+			}
+			result.launches.push_back(l);
+		}
+		results.push_back(result);
+	}
+
+	printJson(results, cold, targetMs);
+	for (const SizeResult& r : results) {
+		vector<double> wall;
+		for (const Launch& l : r.launches) {
+			wall.push_back(l.wallMs);
+		}
+		if (targetMs > 0 && percentile(wall, 90) > targetMs) {
+			return 1;
+		}
+	}
+	return 0;
+}
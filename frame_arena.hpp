@@ -0,0 +1,139 @@
+#ifndef FRAME_ARENA_HPP
+#define FRAME_ARENA_HPP
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+// Linear allocator for the strings a frame hands to nk_label.
+//
+// Nuklear copies label text into its command buffer, so everything built
+// here is garbage once the frame is converted; reset() then drops it all at
+// once. When a frame outgrows the block, the overflow goes to extra blocks and
+// the next reset() replaces them with one block big enough for the whole
+// frame, so the steady state never touches the heap.
+class FrameArena {
+public:
+	explicit FrameArena(size_t capacity = 16 * 1024) {
+		grow(capacity);
+	}
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	// printf into the arena
+	const char* format(const char *fmt, ...) {
+		va_list args;
+		va_start(args, fmt);
+		int length = vsnprintf(nullptr, 0, fmt, args);
+		va_end(args);
+
+		char *out = allocate((size_t) length + 1);
+		va_start(args, fmt);
+		vsnprintf(out, (size_t) length + 1, fmt, args);
+		va_end(args);
+		return out;
+	}
+
+	// Fixed-point number, as formatDouble() prints it
+	const char* number(double value, int precision = 2) {
+		return format("%.*f", precision, value);
+	}
+
+	const char* integer(long value) {
+		return format("%ld", value);
+	}
+
+	// Joins any mix of const char* and std::string
+	template <typename... Parts>
+	const char* concat(const Parts&... parts) {
+		size_t length = (0 + ... + size(parts));
+		char *out = allocate(length + 1);
+		char *at = out;
+		((at = append(at, parts)), ...);
+		*at = '\0';
+		return out;
+	}
+
+	// Called once the frame's labels have been consumed
+	void reset() {
+		if (blocks.size() > 1) {
+			size_t total = 0;
+			for (const Block& block : blocks) {
+				total += block.capacity;
+			}
+			blocks.clear();
+			grow(total);
+		}
+		blocks.back().used = 0;
+		peak = max(peak, bytes);
+		bytes = 0;
+	}
+
+	// Bytes handed out this frame and at most in any frame so far
+	size_t used() const {
+		return bytes;
+	}
+
+	size_t peakUsed() const {
+		return max(peak, bytes);
+	}
+
+	// Bytes reserved across all blocks
+	size_t capacity() const {
+		size_t total = 0;
+		for (const Block& block : blocks) {
+			total += block.capacity;
+		}
+		return total;
+	}
+
+private:
+	struct Block {
+		unique_ptr<char[]> memory;
+		size_t capacity;
+		size_t used;
+	};
+
+	char* allocate(size_t size) {
+		Block *block = &blocks.back();
+		if (block->used + size > block->capacity) {
+			grow(max(size, block->capacity));
+			block = &blocks.back();
+		}
+		char *out = block->memory.get() + block->used;
+		block->used += size;
+		bytes += size;
+		return out;
+	}
+
+	void grow(size_t capacity) {
+		blocks.push_back({unique_ptr<char[]>(new char[capacity]), capacity, 0});
+	}
+
+	static size_t size(const char *s) {
+		return strlen(s);
+	}
+
+	static size_t size(const string& s) {
+		return s.size();
+	}
+
+	static char* append(char *at, const char *s) {
+		size_t length = strlen(s);
+		memcpy(at, s, length);
+		return at + length;
+	}
+
+	static char* append(char *at, const string& s) {
+		memcpy(at, s.data(), s.size());
+		return at + s.size();
+	}
+
+	vector<Block> blocks;
+	size_t bytes = 0;
+	size_t peak = 0;
+};
+
+#endif // FRAME_ARENA_HPP
@@ -0,0 +1,113 @@
+#ifndef FRAME_PIPELINE_HPP
+#define FRAME_PIPELINE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Pipelined rendering: the UI thread builds and converts frame N while a
+// render thread submits frame N-1 to GL and swaps. Two nk_glfw_frame slots
+// carry the converted vertices, elements and draw commands between them.
+//
+// The render thread owns the GL context for the pipeline's lifetime; the
+// constructor takes it from the calling thread and the destructor gives it
+// back, so nothing on the UI thread may touch GL in between. The render
+// thread sets the swap interval it is given once it holds the context.
+class FramePipeline {
+public:
+	FramePipeline(struct nk_glfw *glfw, struct nk_colorf bg, int swapInterval)
+		: glfw(glfw), bg(bg), swapInterval(swapInterval) {
+		for (struct nk_glfw_frame& frame : frames) {
+			nk_glfw3_frame_init(&frame);
+			spare.push_back(&frame);
+		}
+		glfwMakeContextCurrent(nullptr);
+		renderer = thread(&FramePipeline::run, this);
+	}
+
+	~FramePipeline() {
+		{
+			lock_guard<mutex> lock(slots);
+			stopping = true;
+		}
+		changed.notify_all();
+		renderer.join();
+		glfwMakeContextCurrent(glfw->win);
+
+		for (struct nk_glfw_frame& frame : frames) {
+			nk_glfw3_frame_free(&frame);
+		}
+	}
+
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+	// Waits until the render thread is done with one of the two slots
+	struct nk_glfw_frame* acquire() {
+		unique_lock<mutex> lock(slots);
+		changed.wait(lock, [this] { return !spare.empty(); });
+		struct nk_glfw_frame *frame = spare.front();
+		spare.pop_front();
+		return frame;
+	}
+
+	// Hands a converted frame over to the render thread
+	void present(struct nk_glfw_frame *frame) {
+		{
+			lock_guard<mutex> lock(slots);
+			ready.push_back(frame);
+		}
+		changed.notify_all();
+	}
+
+private:
+	void run() {
+		glfwMakeContextCurrent(glfw->win);
+		glfwSwapInterval(swapInterval);
+		profiler.attachThread();
+		tracer.nameThread("render");
+
+		unique_lock<mutex> lock(slots);
+		while (true) {
+			changed.wait(lock, [this] { return stopping || !ready.empty(); });
+			if (ready.empty()) {
+				break;
+			}
+			struct nk_glfw_frame *frame = ready.front();
+			ready.pop_front();
+			lock.unlock();
+
+			glViewport(0, 0, frame->display_width, frame->display_height);
+			glClearColor(bg.r, bg.g, bg.b, bg.a);
+			glClear(GL_COLOR_BUFFER_BIT);
+			nk_glfw3_submit(glfw, frame);
+			{
+				ProfileScope scope(FrameProfiler::Swap);
+				glfwSwapBuffers(glfw->win);
+			}
+
+			lock.lock();
+			spare.push_back(frame);
+			changed.notify_all();
+		}
+		lock.unlock();
+
+		glfwMakeContextCurrent(nullptr);
+	}
+
+	struct nk_glfw *glfw;
+	struct nk_colorf bg;
+	int swapInterval;
+
+	struct nk_glfw_frame frames[2];
+	mutex slots;
+	condition_variable changed;
+	deque<struct nk_glfw_frame*> spare;
+	deque<struct nk_glfw_frame*> ready;
+	bool stopping = false;
+
+	thread renderer;
+};
+
+#endif // FRAME_PIPELINE_HPP
@@ -0,0 +1,196 @@
+#ifndef FRAME_PROFILER_HPP
+#define FRAME_PROFILER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "trace_recorder.hpp"
+
+using namespace std;
+
+// Where a frame's time goes, split into a few named scopes.
+//
+// Scopes nest, and each one is charged only the time not spent in the scopes
+// inside it, so the DB queries a layout pass runs count as DB, not layout.
+// Time outside every scope is reported as Other. Only threads that called
+// attachThread() record, so background work (the write queue's commits) does
+// not show up in frames it did not hold up. Everything recorded between
+// beginFrame() and endFrame() belongs to that frame; with the pipelined
+// renderer, that includes the previous frame's upload, draw and swap.
+//
+// While the trace recorder is open, every scope (on any thread) and every
+// frame also goes to the trace as an event. With both off a scope costs two
+// relaxed loads.
+class FrameProfiler {
+public:
+	enum Scope { DB, Layout, Convert, Upload, Draw, Swap, Other, Frame, Scopes };
+
+	static constexpr const char *names[Scopes] = {"DB", "Layout", "Convert", "Upload", "Draw", "Swap", "Other", "Frame"};
+
+	struct Summary {
+		float min, avg, p99;
+	};
+
+	explicit FrameProfiler(size_t frames = 240) : history(frames), scratch(frames) {}
+
+	bool enabled() const {
+		return on.load(memory_order_relaxed);
+	}
+
+	void setEnabled(bool enable) {
+		for (atomic<long long>& time : spent) {
+			time.store(0, memory_order_relaxed);
+		}
+		on.store(enable, memory_order_relaxed);
+	}
+
+	// Call on each thread whose scopes make up a frame
+	void attachThread() {
+		threadStack().attached = true;
+	}
+
+	// Returns false, and records nothing, while disabled or on other threads
+	// (unless tracing)
+	bool begin(Scope scope) {
+		bool tracing = tracer.enabled();
+		if (!enabled() && !tracing) {
+			return false;
+		}
+		Stack& stack = threadStack();
+		if (!stack.attached && !tracing) {
+			return false;
+		}
+		auto now = chrono::steady_clock::now();
+		if (stack.depth > 0 && stack.attached && enabled()) {
+			charge(stack.scopes[stack.depth - 1], now - stack.since);
+		}
+		if (stack.depth < (int) stack.scopes.size()) {
+			stack.scopes[stack.depth] = scope;
+			stack.started[stack.depth] = now;
+		}
+		stack.depth++;
+		stack.since = now;
+		return true;
+	}
+
+	void end() {
+		Stack& stack = threadStack();
+		if (stack.depth == 0) {
+			return;
+		}
+		auto now = chrono::steady_clock::now();
+		stack.depth--;
+		if (stack.depth < (int) stack.scopes.size()) {
+			Scope scope = stack.scopes[stack.depth];
+			if (stack.attached && enabled()) {
+				charge(scope, now - stack.since);
+			}
+			if (tracer.enabled()) {
+				tracer.complete("scope", names[scope], stack.started[stack.depth], now);
+			}
+		}
+		stack.since = now;
+	}
+
+	void beginFrame() {
+		frameStart = chrono::steady_clock::now();
+	}
+
+	// Files the frame's scope times into the history
+	void endFrame() {
+		if (tracer.enabled()) {
+			tracer.complete("frame", names[Frame], frameStart, chrono::steady_clock::now());
+		}
+		if (!enabled()) {
+			return;
+		}
+		array<float, Scopes>& sample = history[next];
+		float scoped = 0;
+		for (int i = 0; i < Other; ++i) {
+			sample[i] = spent[i].exchange(0, memory_order_relaxed) / 1e6f;
+			scoped += sample[i];
+		}
+		sample[Frame] = chrono::duration<float, milli>(chrono::steady_clock::now() - frameStart).count();
+		sample[Other] = max(sample[Frame] - scoped, 0.0f);
+		next = (next + 1) % history.size();
+		recorded = min(recorded + 1, history.size());
+	}
+
+	// Over the frames in the history
+	Summary summary(Scope scope) const {
+		if (recorded == 0) {
+			return {0, 0, 0};
+		}
+		float total = 0;
+		for (size_t i = 0; i < recorded; ++i) {
+			scratch[i] = history[i][scope];
+			total += scratch[i];
+		}
+		size_t rank = (size_t) (0.99 * (recorded - 1) + 0.5);
+		nth_element(scratch.begin(), scratch.begin() + rank, scratch.begin() + recorded);
+		float p99 = scratch[rank];
+		return {*min_element(scratch.begin(), scratch.begin() + recorded), total / recorded, p99};
+	}
+
+	// Recorded frames, oldest first
+	size_t frames() const {
+		return recorded;
+	}
+
+	float frameMs(size_t index, Scope scope = Frame) const {
+		size_t oldest = recorded < history.size() ? 0 : next;
+		return history[(oldest + index) % history.size()][scope];
+	}
+
+private:
+	struct Stack {
+		array<Scope, 16> scopes;
+		array<chrono::steady_clock::time_point, 16> started;
+		int depth = 0;
+		bool attached = false;
+		chrono::steady_clock::time_point since;
+	};
+
+	static Stack& threadStack() {
+		static thread_local Stack stack;
+		return stack;
+	}
+
+	void charge(Scope scope, chrono::steady_clock::duration time) {
+		spent[scope].fetch_add(chrono::duration_cast<chrono::nanoseconds>(time).count(), memory_order_relaxed);
+	}
+
+	atomic<bool> on{false};
+	array<atomic<long long>, Other> spent{};
+	vector<array<float, Scopes>> history;
+	mutable vector<float> scratch;
+	size_t next = 0;
+	size_t recorded = 0;
+	chrono::steady_clock::time_point frameStart;
+};
+
+FrameProfiler profiler;
+
+// Charges the enclosing block to `scope`:
+//   ProfileScope scope(FrameProfiler::DB);
+class ProfileScope {
+public:
+	explicit ProfileScope(FrameProfiler::Scope scope) : active(profiler.begin(scope)) {}
+
+	~ProfileScope() {
+		if (active) {
+			profiler.end();
+		}
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	bool active;
+};
+
+#endif // FRAME_PROFILER_HPP
@@ -0,0 +1,101 @@
+#ifndef FRAME_REPORT_HPP
+#define FRAME_REPORT_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// What every frame of a replay or a headless run cost: its time, whether it
+// was drawn or skipped as unchanged, and the geometry and draw calls of the
+// drawn ones. Reserve the frame count up front and noting never allocates.
+class FrameReport {
+public:
+	struct Frame {
+		float ms;
+		bool drawn;
+		int vertices, elements, drawCalls;
+	};
+
+	void reserve(size_t count) {
+		frames.reserve(count);
+	}
+
+	void note(double ms, bool drawn, int vertices = 0, int elements = 0, int drawCalls = 0) {
+		frames.push_back({(float) ms, drawn, vertices, elements, drawCalls});
+	}
+
+	// Frame time percentiles, the slowest frames, and geometry per drawn frame
+	void print(ostream& out, const char *what) const {
+		if (frames.empty()) {
+			return;
+		}
+		vector<float> sorted;
+		sorted.reserve(frames.size());
+		double sum = 0;
+		for (const Frame& frame : frames) {
+			sorted.push_back(frame.ms);
+			sum += frame.ms;
+		}
+		sort(sorted.begin(), sorted.end());
+		auto percentile = [&](double p) { return sorted[min((size_t) (p / 100 * (sorted.size() - 1) + 0.5), sorted.size() - 1)]; };
+		out << fixed << setprecision(2) << what << " " << frames.size() << " frames: mean " << sum / frames.size()
+			<< " ms, p50 " << percentile(50) << ", p95 " << percentile(95) << ", p99 " << percentile(99)
+			<< ", max " << sorted.back() << endl;
+
+		vector<size_t> slowest(frames.size());
+		for (size_t i = 0; i < slowest.size(); ++i) {
+			slowest[i] = i;
+		}
+		size_t shown = min(slowest.size(), (size_t) 5);
+		partial_sort(slowest.begin(), slowest.begin() + shown, slowest.end(),
+		             [&](size_t a, size_t b) { return frames[a].ms > frames[b].ms; });
+		out << "slowest frames:";
+		for (size_t i = 0; i < shown; ++i) {
+			out << " #" << slowest[i] + 1 << " (" << frames[slowest[i]].ms << " ms)";
+		}
+		out << endl;
+
+		size_t drawn = 0;
+		double vertices = 0, elements = 0, drawCalls = 0;
+		int maxVertices = 0, maxElements = 0, maxDrawCalls = 0;
+		for (const Frame& frame : frames) {
+			if (frame.drawn) {
+				drawn++;
+				vertices += frame.vertices;
+				elements += frame.elements;
+				drawCalls += frame.drawCalls;
+				maxVertices = max(maxVertices, frame.vertices);
+				maxElements = max(maxElements, frame.elements);
+				maxDrawCalls = max(maxDrawCalls, frame.drawCalls);
+			}
+		}
+		out << drawn << " drawn, " << frames.size() - drawn << " skipped as unchanged";
+		if (drawn && maxVertices) {
+			out << setprecision(0) << "; per drawn frame " << vertices / drawn << " vertices (max " << maxVertices
+				<< "), " << elements / drawn << " elements (max " << maxElements << "), " << setprecision(1)
+				<< drawCalls / drawn << " draw calls (max " << maxDrawCalls << ")";
+		}
+		out << endl;
+	}
+
+	// One line per frame: frame number, milliseconds, drawn, geometry
+	bool writeCsv(const string& path) const {
+		ofstream out(path);
+		out << "frame,ms,drawn,vertices,elements,draw_calls" << endl << fixed << setprecision(3);
+		for (size_t i = 0; i < frames.size(); ++i) {
+			const Frame& frame = frames[i];
+			out << i + 1 << "," << frame.ms << "," << frame.drawn << "," << frame.vertices << ","
+				<< frame.elements << "," << frame.drawCalls << "\n";
+		}
+		return (bool) out;
+	}
+
+private:
+	vector<Frame> frames;
+};
+
+#endif // FRAME_REPORT_HPP
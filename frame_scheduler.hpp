@@ -0,0 +1,143 @@
+#ifndef FRAME_SCHEDULER_HPP
+#define FRAME_SCHEDULER_HPP
+
+#include <atomic>
+#include <functional>
+#include <limits>
+
+// Decides when the main loop draws a frame.
+//
+// While the user interacts (and for `grace` seconds after the last input) it
+// polls and draws every frame at v-sync rate, exactly like before. Otherwise it
+// sleeps in glfwWaitEventsTimeout until an input event, a requestFrame() from
+// any thread, a wakeAt() deadline or a poll() that reports a change. Those
+// last three draw `settleFrames` frames, so state Nuklear only picks up a
+// frame late (hover, scrollbars) catches up. Polls run in both modes.
+//
+// A frame that was skipped rather than swapped did not block on v-sync; after
+// one, wait() paces the loop itself by waiting out a `refresh` period.
+class FrameScheduler {
+public:
+	FrameScheduler(bool idle = true, double grace = 0.25, int settleFrames = 2, double refresh = 1.0 / 60)
+		: idle(idle), grace(grace), settleFrames(settleFrames), refresh(refresh) {}
+
+	// Returns once the next frame is due, with the events processed
+	void wait() {
+		while (true) {
+			double now = glfwGetTime();
+			bool due = now >= wakeTime;
+			if (runPolls(now) || requested.exchange(false) || due) {
+				settle = max(settle, settleFrames);
+				if (due) {
+					wakeTime = never;
+				}
+			}
+			if (!idle || now < activeUntil || settle > 0) {
+				settle = max(settle - 1, 0);
+				double paceUntil = skippedAt + refresh;
+				skippedAt = -never;
+				if (now < paceUntil) {
+					glfwWaitEventsTimeout(paceUntil - now);
+				} else {
+					glfwPollEvents();
+				}
+				return;
+			}
+
+			double deadline = min(wakeTime, nextPoll());
+			if (deadline == never) {
+				glfwWaitEvents();
+			} else {
+				glfwWaitEventsTimeout(deadline - now);
+			}
+
+			// Woken early by something other than requestFrame(): input
+			now = glfwGetTime();
+			if (now < deadline && !requested) {
+				activeUntil = now + grace;
+			}
+		}
+	}
+
+	// Draw another frame soon; safe to call from any thread
+	void requestFrame() {
+		requested = true;
+		glfwPostEmptyEvent();
+	}
+
+	// Keeps drawing continuously while input is going on, even without new
+	// events (a held mouse button, a drag). True if there was any.
+	bool noteInput(const struct nk_input& in) {
+		bool active = in.mouse.delta.x != 0 || in.mouse.delta.y != 0 ||
+			in.mouse.scroll_delta.x != 0 || in.mouse.scroll_delta.y != 0 || in.keyboard.text_len > 0;
+		for (int i = 0; i < NK_BUTTON_MAX && !active; ++i) {
+			active = in.mouse.buttons[i].down || in.mouse.buttons[i].clicked;
+		}
+		// Key `clicked` counts are no use here: the backend reports some
+		// keys every frame whether they changed or not
+		for (int i = 0; i < NK_KEY_MAX && !active; ++i) {
+			active = in.keyboard.keys[i].down;
+		}
+		if (active) {
+			activeUntil = glfwGetTime() + grace;
+		}
+		return active;
+	}
+
+	// The frame just built matched the one on screen and was not swapped
+	void frameSkipped() {
+		skippedAt = glfwGetTime();
+	}
+
+	// Draw at `time` (glfwGetTime() seconds) even if nothing else happens
+	void wakeAt(double time) {
+		wakeTime = min(wakeTime, time);
+	}
+
+	// Calls `changed` every `period` seconds; true draws a frame
+	void poll(double period, function<bool()> changed) {
+		polls.push_back({period, glfwGetTime() + period, changed});
+	}
+
+private:
+	struct Poll {
+		double period;
+		double due;
+		function<bool()> changed;
+	};
+
+	static constexpr double never = numeric_limits<double>::infinity();
+
+	double nextPoll() const {
+		double due = never;
+		for (const Poll& p : polls) {
+			due = min(due, p.due);
+		}
+		return due;
+	}
+
+	bool runPolls(double now) {
+		bool changed = false;
+		for (Poll& p : polls) {
+			if (now >= p.due) {
+				p.due = now + p.period;
+				changed = p.changed() || changed;
+			}
+		}
+		return changed;
+	}
+
+	bool idle;
+	double grace;
+	int settleFrames;
+	double refresh;
+
+	atomic<bool> requested{true};
+	double activeUntil = 0;
+	double wakeTime = never;
+	double skippedAt = -never;
+	int settle = 0;
+	vector<Poll> polls;
+};
+
+#endif // FRAME_SCHEDULER_HPP
@@ -8,6 +8,13 @@
 #include <ctime>
 #include <vector>
 #include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "frame_profiler.hpp"
+#include "sql_trace.hpp"
 
 using namespace std;
 
@@ -20,17 +27,108 @@ struct Purchase {
 	string type;
 };
 
-void runCommand(sqlite3 *db, const char* inp) {
+// How long SQLite itself waits on a lock held by another connection. The
+// write queue waits far less per attempt, since the UI thread reads through
+// the same connection (see WriteQueue::commit()).
+const int busyTimeoutMs = 2000;
+
+// SQLITE_BUSY / SQLITE_LOCKED (and their extended codes) mean another
+// connection holds the lock; the statement can simply be tried again
+bool isBusy(int rc) {
+	return (rc & 0xff) == SQLITE_BUSY || (rc & 0xff) == SQLITE_LOCKED;
+}
+
+// Runs attempt() until it stops reporting lock contention, backing off
+// exponentially (with jitter, so competing writers spread out) between tries
+template <typename F>
+int retryBusy(F attempt, int maxAttempts = 8) {
+	static thread_local minstd_rand jitter(random_device{}());
+	int rc = attempt();
+	for (int i = 1; i < maxAttempts && isBusy(rc); ++i) {
+		int delayMs = 1 << min(i, 7);
+		this_thread::sleep_for(chrono::milliseconds(delayMs + jitter() % delayMs));
+		rc = attempt();
+	}
+	return rc;
+}
+
+// Runs SQL that returns no rows. SQLite's busy timeout already waits up to
+// busyTimeoutMs for a lock held by another connection; if it is still held
+// after that, the busy code comes back, and callers that open a transaction
+// have to check for it.
+int runCommand(sqlite3 *db, const char* inp) {
+	ProfileScope scope(FrameProfiler::DB);
 	char *error = nullptr;
 	int rc = sqlite3_exec(db, inp, nullptr, nullptr, &error);
 	if (rc) {
-		cerr << "SQL error: " << error << endl;
-		exit(1);
+		cerr << "SQL error: " << (error ? error : sqlite3_errmsg(db)) << endl;
+		sqlite3_free(error);
+		// Lock contention is recoverable, anything else is a bug
+		if (!isBusy(rc)) {
+			exit(1);
+		}
+	}
+	return rc;
+}
+
+int runCommand(sqlite3 *db, string inp) {
+	return runCommand(db, inp.c_str());
+}
+
+// Opens a database that other processes may use at the same time: WAL lets
+// readers carry on while a writer commits, and the busy timeout makes SQLite
+// wait for a lock instead of failing straight away
+int openDatabase(const char* path, sqlite3 **db) {
+	int rc = sqlite3_open_v2(path, db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, nullptr);
+	if (rc) {
+		return rc;
+	}
+	sqlite3_busy_timeout(*db, busyTimeoutMs);
+	sqlTrace.attach(*db);
+	runCommand(*db, "PRAGMA journal_mode=WAL;");
+	return SQLITE_OK;
+}
+
+// Copies the database at `from`, including whatever is still in its WAL, to
+// a new database at `to` (replacing it)
+int copyDatabase(const char* from, const char* to) {
+	for (const char *suffix : {"", "-wal", "-shm"}) {
+		remove((string(to) + suffix).c_str());
+	}
+	sqlite3 *source, *copy;
+	int rc = sqlite3_open_v2(from, &source, SQLITE_OPEN_READONLY, nullptr);
+	if (rc == SQLITE_OK) {
+		rc = sqlite3_open(to, &copy);
+		if (rc == SQLITE_OK) {
+			sqlite3_backup *backup = sqlite3_backup_init(copy, "main", source, "main");
+			if (backup) {
+				sqlite3_backup_step(backup, -1);
+				rc = sqlite3_backup_finish(backup);
+			} else {
+				rc = sqlite3_errcode(copy);
+			}
+		}
+		sqlite3_close(copy);
 	}
+	sqlite3_close(source);
+	return rc;
 }
 
-void runCommand(sqlite3 *db, string inp) {
-	runCommand(db, inp.c_str());
+void createSchema(sqlite3 *db) {
+	runCommand(db, "CREATE TABLE IF NOT EXISTS purchases ("
+	                    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+	                    "name TEXT,"
+	                    "quantity REAL,"
+	                    "price REAL,"
+	                    "timeStamp TEXT,"
+	                    "type TEXT"
+	                ");");
+
+	// Lets the purchases list stream in date order without sorting first
+	runCommand(db, "CREATE INDEX IF NOT EXISTS purchases_timeStamp ON purchases (timeStamp);");
+
+	// Deleted purchases that live in a read-only archive
+	runCommand(db, "CREATE TABLE IF NOT EXISTS purchase_tombstones (id INTEGER PRIMARY KEY);");
 }
 
 string getTimeStamp() {
@@ -41,13 +139,31 @@ string getTimeStamp() {
 	return string(buffer);
 }
 
-void insert(sqlite3 *db, string name, double quantity, double price, string type = "") {
+// date('now') is UTC, so every "last N days" window moves on at UTC midnight
+int secondsUntilNextDay() {
+	return 86400 - (int) (time(nullptr) % 86400);
+}
+
+// Changes whenever another connection commits to the database
+long long getDataVersion(sqlite3 *db) {
+	ProfileScope scope(FrameProfiler::DB);
+	sqlite3_stmt *stmt;
+	long long version = 0;
+	if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, nullptr) == SQLITE_OK &&
+		sqlite3_step(stmt) == SQLITE_ROW) {
+		version = sqlite3_column_int64(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	return version;
+}
+
+string resolveType(sqlite3 *db, const string& name, string type = "") {
 	// Default type logic
 	if (type.empty()) {
-		stringstream query;
-		query << "SELECT type FROM purchases WHERE name = '" << name << "' LIMIT 1;";
+		ProfileScope scope(FrameProfiler::DB);
 		sqlite3_stmt *stmt;
-		if (sqlite3_prepare_v2(db, query.str().c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+		if (sqlite3_prepare_v2(db, "SELECT type FROM purchases WHERE name = ? LIMIT 1;", -1, &stmt, nullptr) == SQLITE_OK) {
+			sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
 			if (sqlite3_step(stmt) == SQLITE_ROW) {
 				const unsigned char *foundType = sqlite3_column_text(stmt, 0);
 				if (foundType) {
@@ -62,18 +178,107 @@ void insert(sqlite3 *db, string name, double quantity, double price, string type
 		}
 	}
 
-	// Insert command
-	stringstream command;
-	command << "INSERT INTO purchases (name, quantity, price, timeStamp, type) VALUES ('"
-			<< name << "', "
-			<< quantity << ", "
-			<< price << ", '"
-			<< getTimeStamp() << "', '"
-			<< type << "');";
-	runCommand(db, command.str());
+	return type;
+}
+
+// Inserts and deletes of purchases as prepared statements. The values are
+// bound, never pasted into the SQL, so a name like "Kellogg's" is stored as
+// typed. A purchase that is not in the hot table lives in a read-only
+// archive, so deleting it records a tombstone instead (see shards.hpp).
+class PurchaseStatements {
+public:
+	explicit PurchaseStatements(sqlite3 *db) {
+		const char *sql[] = {
+			"INSERT INTO main.purchases (name, quantity, price, timeStamp, type) VALUES (?, ?, ?, ?, ?);",
+			"INSERT OR IGNORE INTO main.purchase_tombstones (id) SELECT ?1 "
+				"WHERE NOT EXISTS (SELECT 1 FROM main.purchases WHERE id = ?1);",
+			"DELETE FROM main.purchases WHERE id = ?1;",
+		};
+		for (int i = 0; i < 3 && prepared == SQLITE_OK; ++i) {
+			prepared = sqlite3_prepare_v2(db, sql[i], -1, &stmts[i], nullptr);
+		}
+	}
+
+	~PurchaseStatements() {
+		for (sqlite3_stmt *stmt : stmts) {
+			sqlite3_finalize(stmt);
+		}
+	}
+
+	PurchaseStatements(const PurchaseStatements&) = delete;
+	PurchaseStatements& operator=(const PurchaseStatements&) = delete;
+
+	// SQLITE_OK or the error code; sqlite3_errmsg() has the message
+	int insert(const Purchase& p) {
+		if (prepared != SQLITE_OK) {
+			return prepared;
+		}
+		return run(bindInsert(p));
+	}
+
+	int remove(int id) {
+		if (prepared != SQLITE_OK) {
+			return prepared;
+		}
+		int rc = run(bindId(stmts[Tombstone], id));
+		return rc == SQLITE_OK ? run(bindId(stmts[Delete], id)) : rc;
+	}
+
+	// The same writes as SQL text with the values quoted, to save them to a
+	// file; empty if the statements could not be prepared
+	string insertSql(const Purchase& p) {
+		return prepared == SQLITE_OK ? expand(bindInsert(p)) : "";
+	}
+
+	string removeSql(int id) {
+		return prepared == SQLITE_OK ? expand(bindId(stmts[Tombstone], id)) + "\n" + expand(bindId(stmts[Delete], id)) : "";
+	}
+
+private:
+	enum { Insert, Tombstone, Delete };
+
+	sqlite3_stmt* bindInsert(const Purchase& p) {
+		sqlite3_stmt *stmt = stmts[Insert];
+		sqlite3_bind_text(stmt, 1, p.name.c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_double(stmt, 2, p.quantity);
+		sqlite3_bind_double(stmt, 3, p.price);
+		sqlite3_bind_text(stmt, 4, p.timeStamp.c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(stmt, 5, p.type.c_str(), -1, SQLITE_TRANSIENT);
+		return stmt;
+	}
+
+	static sqlite3_stmt* bindId(sqlite3_stmt *stmt, int id) {
+		sqlite3_bind_int(stmt, 1, id);
+		return stmt;
+	}
+
+	static int run(sqlite3_stmt *stmt) {
+		int rc = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+		return rc == SQLITE_DONE ? SQLITE_OK : rc;
+	}
+
+	static string expand(sqlite3_stmt *stmt) {
+		char *sql = sqlite3_expanded_sql(stmt);
+		string text = sql ? sql : "";
+		sqlite3_free(sql);
+		return text;
+	}
+
+	sqlite3_stmt *stmts[3] = {};
+	int prepared = SQLITE_OK;
+};
+
+void insert(sqlite3 *db, string name, double quantity, double price, string type = "") {
+	ProfileScope scope(FrameProfiler::DB);
+	Purchase p = {0, name, quantity, price, getTimeStamp(), resolveType(db, name, type)};
+	if (PurchaseStatements(db).insert(p) != SQLITE_OK) {
+		cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
+	}
 }
 
 double getTotalSpent(sqlite3 *db, string item, int days) {
+	ProfileScope scope(FrameProfiler::DB);
 	stringstream command;
 	command << "SELECT SUM(quantity * price) FROM purchases "
 			<< "WHERE name = '" << item << "' "
@@ -94,6 +299,7 @@ double getTotalSpent(sqlite3 *db, string item, int days) {
 }
 
 double getTotalSpent(sqlite3* db, int days) {
+	ProfileScope scope(FrameProfiler::DB);
 	stringstream command;
 	command << "SELECT SUM(quantity * price) FROM purchases "
 			<< "WHERE timeStamp >= date('now', '-" << days << " day');";
@@ -113,6 +319,7 @@ double getTotalSpent(sqlite3* db, int days) {
 }
 
 double getTotalSpent(sqlite3* db) {
+	ProfileScope scope(FrameProfiler::DB);
 	string command = "SELECT SUM(quantity * price) FROM purchases;";
 	sqlite3_stmt* stmt;
 	double total = 0;
@@ -128,6 +335,7 @@ double getTotalSpent(sqlite3* db) {
 }
 
 double getAverageSpentPerDayLastMonth(sqlite3* db) {
+	ProfileScope scope(FrameProfiler::DB);
 	stringstream query;
 	query << "SELECT AVG(daily_total) FROM ("
 		  << "SELECT date(timeStamp) as day, SUM(quantity * price) as daily_total "
@@ -148,6 +356,7 @@ double getAverageSpentPerDayLastMonth(sqlite3* db) {
 }
 
 double getTotalQuantity(sqlite3 *db, string item, int days) {
+	ProfileScope scope(FrameProfiler::DB);
 	stringstream command;
 	command << "SELECT SUM(quantity) FROM purchases "
 			<< "WHERE name = '" << item << "' "
@@ -178,11 +387,18 @@ double getAveragePrice(sqlite3 *db, string item, int days) {
 	return totalSpent / totalQuantity;
 }
 
+// timeStamp within the day `date` (YYYY-MM-DD), as a range the timeStamp
+// index can answer, where substr(timeStamp, 1, 10) would scan every row
+string onDate(const string& date) {
+	return "timeStamp >= '" + date + "' AND timeStamp < date('" + date + "', '+1 day')";
+}
+
 double getTotalSpentOnDate(sqlite3* db, string timeStamp) {
+	ProfileScope scope(FrameProfiler::DB);
 	string datePart = timeStamp.substr(0, 10);
 	stringstream command;
 	command << "SELECT SUM(quantity * price) FROM purchases "
-			<< "WHERE substr(timeStamp, 1, 10) = '" << datePart << "';";
+			<< "WHERE " << onDate(datePart) << ";";
 
 	sqlite3_stmt* stmt;
 	double total = 0.0;
@@ -196,21 +412,27 @@ double getTotalSpentOnDate(sqlite3* db, string timeStamp) {
 	return total;
 }
 
+const char* loadPurchasesQuery = "SELECT id, name, quantity, price, timeStamp, type FROM purchases ORDER BY timeStamp DESC, id DESC;";
+
+Purchase readPurchase(sqlite3_stmt* stmt) {
+	Purchase p;
+	p.id = sqlite3_column_int(stmt, 0);
+	p.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+	p.quantity = sqlite3_column_double(stmt, 2);
+	p.price = sqlite3_column_double(stmt, 3);
+	p.timeStamp = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+	p.type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
+	return p;
+}
+
 vector<Purchase> loadPurchases(sqlite3* db) {
+	ProfileScope scope(FrameProfiler::DB);
 	vector<Purchase> purchases;
-	string command = "SELECT id, name, quantity, price, timeStamp, type FROM purchases ORDER BY timeStamp DESC, id DESC;";
 	sqlite3_stmt* stmt;
 	
-	if (sqlite3_prepare_v2(db, command.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+	if (sqlite3_prepare_v2(db, loadPurchasesQuery, -1, &stmt, nullptr) == SQLITE_OK) {
 		while (sqlite3_step(stmt) == SQLITE_ROW) {
-			Purchase p;
-			p.id = sqlite3_column_int(stmt, 0);
-			p.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-			p.quantity = sqlite3_column_double(stmt, 2);
-			p.price = sqlite3_column_double(stmt, 3);
-			p.timeStamp = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-			p.type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
-			purchases.push_back(p);
+			purchases.push_back(readPurchase(stmt));
 		}
 	}
 	sqlite3_finalize(stmt);
@@ -225,12 +447,14 @@ string formatDouble(double value, int precision = 2) {
 }
 
 void deletePurchase(sqlite3 *db, int id) {
-	stringstream ss;
-	ss << "DELETE FROM purchases WHERE id = " << id << ";";
-	runCommand(db, ss.str());
+	ProfileScope scope(FrameProfiler::DB);
+	if (PurchaseStatements(db).remove(id) != SQLITE_OK) {
+		cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
+	}
 }
 
 double getTotalSpentByType(sqlite3* db, const string& type, int days) {
+	ProfileScope scope(FrameProfiler::DB);
 	stringstream command;
 	command << "SELECT SUM(quantity * price) FROM purchases "
 			<< "WHERE type = '" << type << "' "
@@ -251,9 +475,10 @@ double getTotalSpentByType(sqlite3* db, const string& type, int days) {
 }
 
 double getTotalSpentOnExactDate(sqlite3* db, const string& date) {
+	ProfileScope scope(FrameProfiler::DB);
 	stringstream command;
 	command << "SELECT SUM(quantity * price) FROM purchases "
-			<< "WHERE substr(timeStamp, 1, 10) = '" << date << "';";
+			<< "WHERE " << onDate(date) << ";";
 
 	sqlite3_stmt* stmt;
 	double totalSpent = 0;
@@ -270,9 +495,10 @@ double getTotalSpentOnExactDate(sqlite3* db, const string& date) {
 }
 
 int getUniqueItemsOnDate(sqlite3* db, string date) {
+	ProfileScope scope(FrameProfiler::DB);
 	stringstream command;
 	command << "SELECT COUNT(DISTINCT name) FROM purchases "
-			<< "WHERE substr(timeStamp, 1, 10) = '" << date << "';";
+			<< "WHERE " << onDate(date) << ";";
 
 	sqlite3_stmt* stmt;
 	int count = 0;
@@ -288,6 +514,7 @@ int getUniqueItemsOnDate(sqlite3* db, string date) {
 }
 
 int getUniqueItemsByTypeLast30Days(sqlite3* db, string type) {
+	ProfileScope scope(FrameProfiler::DB);
 	stringstream command;
 	command << "SELECT COUNT(DISTINCT name) FROM purchases "
 			<< "WHERE type = '" << type << "' "
@@ -306,4 +533,30 @@ int getUniqueItemsByTypeLast30Days(sqlite3* db, string type) {
 	return count;
 }
 
+// Autocomplete for the name field: distinct names starting with prefix,
+// ignoring case
+vector<string> getNameSuggestions(sqlite3* db, const string& prefix, int limit = 5) {
+	ProfileScope scope(FrameProfiler::DB);
+	vector<string> names;
+	if (prefix.empty()) {
+		return names;
+	}
+
+	sqlite3_stmt* stmt;
+	const char* query = "SELECT DISTINCT name FROM purchases "
+	                    "WHERE LOWER(name) LIKE LOWER(?1 || '%') "
+	                    "ORDER BY name COLLATE NOCASE "
+	                    "LIMIT ?2;";
+	if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) == SQLITE_OK) {
+		sqlite3_bind_text(stmt, 1, prefix.c_str(), (int) prefix.size(), SQLITE_TRANSIENT);
+		sqlite3_bind_int(stmt, 2, limit);
+		while (sqlite3_step(stmt) == SQLITE_ROW) {
+			names.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+		}
+	}
+	sqlite3_finalize(stmt);
+
+	return names;
+}
+
 #endif // HELPERS_HPP
@@ -0,0 +1,261 @@
+#ifndef INPUT_RECORDER_HPP
+#define INPUT_RECORDER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Input sessions: --record saves the input nk_glfw3_new_frame gathers, one
+// record per frame, and --replay feeds it back frame for frame, while
+// FrameReport times every frame.
+//
+// The file starts with "BNIN" and a version byte. Each frame then holds the
+// time since the previous one in microseconds and a byte of flags saying
+// which parts changed since the previous frame, followed by those parts, so
+// a frame without input takes three bytes. Integers are LEB128 varints,
+// signed ones zigzag encoded.
+namespace input_session {
+	const char magic[4] = {'B', 'N', 'I', 'N'};
+	const uint8_t version = 1;
+
+	enum Parts : uint8_t {
+		Cursor = 1,      // dx, dy
+		Buttons = 2,     // held buttons, double click in bit 3
+		DoubleClick = 4, // x, y
+		Scroll = 8,      // x, y as floats
+		Held = 16,       // nk_glfw_held_keys bits
+		Keys = 32,       // count, then key / state byte pairs
+		Text = 64        // count, then codepoints
+	};
+}
+
+class InputRecorder {
+public:
+	bool open(const string& path) {
+		out.open(path, ios::binary | ios::trunc);
+		out.write(input_session::magic, sizeof(input_session::magic));
+		out.put((char) input_session::version);
+		return (bool) out;
+	}
+
+	bool isOpen() const {
+		return out.is_open();
+	}
+
+	void record(const struct nk_glfw_input& in) {
+		using namespace input_session;
+		uint8_t parts = 0;
+		parts |= in.x != last.x || in.y != last.y ? Cursor : 0;
+		parts |= in.buttons != last.buttons || in.double_click != last.double_click ? Buttons : 0;
+		parts |= in.double_click_pos.x != last.double_click_pos.x || in.double_click_pos.y != last.double_click_pos.y ? DoubleClick : 0;
+		parts |= in.scroll.x != 0 || in.scroll.y != 0 ? Scroll : 0;
+		parts |= in.held != last.held ? Held : 0;
+		int keys = (int) count_if(begin(in.key_events), end(in.key_events), [](nk_char state) { return state >= 0; });
+		parts |= keys ? Keys : 0;
+		parts |= in.text_len ? Text : 0;
+
+		putVarint((uint64_t) max(in.delta_time * 1e6f, 0.0f));
+		out.put((char) parts);
+		if (parts & Cursor) {
+			putSigned(in.x - last.x);
+			putSigned(in.y - last.y);
+		}
+		if (parts & Buttons) {
+			out.put((char) (in.buttons | (in.double_click ? 8 : 0)));
+		}
+		if (parts & DoubleClick) {
+			putSigned((int) in.double_click_pos.x);
+			putSigned((int) in.double_click_pos.y);
+		}
+		if (parts & Scroll) {
+			out.write(reinterpret_cast<const char*>(&in.scroll.x), sizeof(float));
+			out.write(reinterpret_cast<const char*>(&in.scroll.y), sizeof(float));
+		}
+		if (parts & Held) {
+			out.put((char) in.held);
+		}
+		if (parts & Keys) {
+			putVarint(keys);
+			for (int key = 0; key < NK_KEY_MAX; ++key) {
+				if (in.key_events[key] >= 0) {
+					out.put((char) key);
+					out.put((char) in.key_events[key]);
+				}
+			}
+		}
+		if (parts & Text) {
+			putVarint(in.text_len);
+			for (int i = 0; i < in.text_len; ++i) {
+				putVarint(in.text[i]);
+			}
+		}
+		last = in;
+		last.double_click_pos.x = (float) (int) in.double_click_pos.x;
+		last.double_click_pos.y = (float) (int) in.double_click_pos.y;
+		recorded++;
+	}
+
+	unsigned long frames() const {
+		return recorded;
+	}
+
+	void close() {
+		out.close();
+	}
+
+private:
+	void putVarint(uint64_t value) {
+		while (value >= 0x80) {
+			out.put((char) (value | 0x80));
+			value >>= 7;
+		}
+		out.put((char) value);
+	}
+
+	void putSigned(int64_t value) {
+		putVarint(((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+	}
+
+	ofstream out;
+	struct nk_glfw_input last = {};
+	unsigned long recorded = 0;
+};
+
+class InputReplay {
+public:
+	// False if `path` is missing, not a recording, or cut short
+	bool open(const string& path) {
+		ifstream in(path, ios::binary);
+		data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+		if (data.size() < 5 || memcmp(data.data(), input_session::magic, 4) || data[4] != input_session::version) {
+			return false;
+		}
+
+		// Count the frames up front, for FrameReport::reserve
+		pos = 5;
+		struct nk_glfw_input scratch = {};
+		total = 0;
+		while (pos < data.size()) {
+			if (!decode(scratch)) {
+				return false;
+			}
+			total++;
+		}
+		pos = 5;
+		current = {};
+		return true;
+	}
+
+	bool done() const {
+		return pos >= data.size();
+	}
+
+	// Replaces `in` with the next recorded frame
+	void next(struct nk_glfw_input& in) {
+		if (!done()) {
+			decode(current);
+			in = current;
+		}
+	}
+
+	unsigned long frames() const {
+		return total;
+	}
+
+private:
+	bool decode(struct nk_glfw_input& in) {
+		using namespace input_session;
+		uint64_t micros;
+		if (!getVarint(micros) || pos >= data.size()) {
+			return false;
+		}
+		in.delta_time = micros / 1e6f;
+		uint8_t parts = data[pos++];
+		bool ok = true;
+		if (parts & Cursor) {
+			int64_t dx = 0, dy = 0;
+			ok = getSigned(dx) && getSigned(dy);
+			in.x += (int) dx;
+			in.y += (int) dy;
+		}
+		if (ok && (parts & Buttons)) {
+			ok = pos < data.size();
+			uint8_t buttons = ok ? data[pos++] : 0;
+			in.buttons = buttons & 7;
+			in.double_click = (buttons & 8) != 0;
+		}
+		if (ok && (parts & DoubleClick)) {
+			int64_t x = 0, y = 0;
+			ok = getSigned(x) && getSigned(y);
+			in.double_click_pos = nk_vec2((float) x, (float) y);
+		}
+		in.scroll = nk_vec2(0, 0);
+		if (ok && (parts & Scroll)) {
+			ok = pos + 2 * sizeof(float) <= data.size();
+			if (ok) {
+				memcpy(&in.scroll.x, &data[pos], sizeof(float));
+				memcpy(&in.scroll.y, &data[pos + sizeof(float)], sizeof(float));
+				pos += 2 * sizeof(float);
+			}
+		}
+		if (ok && (parts & Held)) {
+			ok = pos < data.size();
+			in.held = ok ? data[pos++] : 0;
+		}
+		memset(in.key_events, -1, sizeof(in.key_events));
+		if (ok && (parts & Keys)) {
+			uint64_t keys = 0;
+			ok = getVarint(keys) && pos + 2 * keys <= data.size();
+			for (uint64_t i = 0; ok && i < keys; ++i, pos += 2) {
+				ok = data[pos] < NK_KEY_MAX;
+				if (ok) {
+					in.key_events[data[pos]] = (nk_char) data[pos + 1];
+				}
+			}
+		}
+		in.text_len = 0;
+		if (ok && (parts & Text)) {
+			uint64_t length = 0;
+			ok = getVarint(length) && length <= NK_GLFW_TEXT_MAX;
+			for (uint64_t i = 0; ok && i < length; ++i) {
+				uint64_t codepoint = 0;
+				ok = getVarint(codepoint);
+				in.text[in.text_len++] = (unsigned int) codepoint;
+			}
+		}
+		return ok;
+	}
+
+	bool getVarint(uint64_t& value) {
+		value = 0;
+		for (int shift = 0; pos < data.size() && shift < 64; shift += 7) {
+			uint8_t byte = data[pos++];
+			value |= (uint64_t) (byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool getSigned(int64_t& value) {
+		uint64_t raw;
+		if (!getVarint(raw)) {
+			return false;
+		}
+		value = (int64_t) (raw >> 1) ^ -(int64_t) (raw & 1);
+		return true;
+	}
+
+	vector<uint8_t> data;
+	size_t pos = 0;
+	unsigned long total = 0;
+	struct nk_glfw_input current = {};
+};
+
+#endif // INPUT_RECORDER_HPP
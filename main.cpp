@@ -5,6 +5,9 @@
 #include <ctime>
 #include <vector>
 #include <iomanip>
+#include <cstring>
+#include <memory>
+#include <filesystem>
 
 // Nuklear / GLFW
 #define NK_INCLUDE_STANDARD_IO
@@ -12,6 +15,8 @@
 #define NK_INCLUDE_VERTEX_BUFFER_OUTPUT
 #define NK_INCLUDE_FONT_BAKING
 #define NK_INCLUDE_DEFAULT_FONT
+#define NK_UINT_DRAW_INDEX // a full table can pass 65536 vertices; keep in sync with nuklear.c
+#define NK_ZERO_COMMAND_MEMORY // padding in the command buffer hashes the same every frame
 #include "nuklear.h"
 
 #define GL_GLEXT_PROTOTYPES
@@ -24,37 +29,292 @@
 
 // Helper functions
 #include "helpers.hpp"
+#include "shards.hpp"
+#include "write_queue.hpp"
+#include "purchase_loader.hpp"
+#include "frame_pipeline.hpp"
+#include "table_hit_test.hpp"
+#include "frame_scheduler.hpp"
+#include "frame_arena.hpp"
+#include "alloc_counter.hpp"
+#include "profiler_overlay.hpp"
+#include "input_recorder.hpp"
+#include "ui_script.hpp"
+#include "frame_report.hpp"
+#include "png_writer.hpp"
+#include "startup_timer.hpp"
+#include "memory_stats.hpp"
 
 using namespace std;
 
-int main() {
+int main(int argc, char **argv) {
+	// Command line
+	bool pipelined = false; // build frame N while frame N-1 renders
+	bool continuous = false; // draw every frame instead of only on change
+	bool debugAllocations = false; // report frames that touch the heap, and from where
+	long allocBudget = -1; // fail if an idle frame allocates more often than this
+	bool renderStats = false; // print the backend's render timing at exit
+	bool retained = true; // reuse the geometry of windows that did not change
+	bool profile = false; // start with the profiler overlay open (F12 toggles it)
+	enum nk_glfw_upload upload = NK_GLFW_UPLOAD_AUTO;
+	string archiveDir = ".";  // where the per-year archives live
+	string sqlTraceFile; // time every SQL statement, written here (F11 shows them)
+	string traceFile; // record a timeline of frames, queries and tasks (F10 flushes it)
+	string dbPath = "data.db";
+	string recordFile; // save every frame's input here
+	string replayFile; // play recorded input back and time each frame
+	string frameTimesFile; // replay or headless: per-frame times as CSV
+	bool headless = false; // render offscreen through a scripted workload (or --replay)
+	string pngDir; // headless: write the framebuffer here as PNG
+	int pngEvery = 0; // every this many frames, as well as the last one
+	bool startupReport = false; // print startup phase times at the first usable frame
+	bool exitAfterStartup = false; // and quit there
+	bool memoryReport = false; // print where the memory goes at exit
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--pipelined")) {
+			pipelined = true;
+		} else if (!strcmp(argv[i], "--continuous")) {
+			continuous = true;
+		} else if (!strcmp(argv[i], "--debug-allocations")) {
+			debugAllocations = true;
+		} else if (!strcmp(argv[i], "--alloc-budget") && i + 1 < argc) {
+			allocBudget = atol(argv[++i]);
+		} else if (!strcmp(argv[i], "--render-stats")) {
+			renderStats = true;
+		} else if (!strcmp(argv[i], "--no-retained")) {
+			retained = false;
+		} else if (!strcmp(argv[i], "--profile")) {
+			profile = true;
+		} else if (!strcmp(argv[i], "--upload") && i + 1 < argc) {
+			string path = argv[++i];
+			if (path == "persistent") upload = NK_GLFW_UPLOAD_PERSISTENT;
+			else if (path == "map-range") upload = NK_GLFW_UPLOAD_MAP_RANGE;
+			else if (path == "orphan") upload = NK_GLFW_UPLOAD_ORPHAN;
+			else {
+				cerr << "Unknown upload path " << path << endl;
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--archive-dir") && i + 1 < argc) {
+			archiveDir = argv[++i];
+		} else if (!strcmp(argv[i], "--sql-trace") && i + 1 < argc) {
+			sqlTraceFile = argv[++i];
+		} else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			traceFile = argv[++i];
+		} else if (!strcmp(argv[i], "--db") && i + 1 < argc) {
+			dbPath = argv[++i];
+		} else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+			recordFile = argv[++i];
+		} else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+			replayFile = argv[++i];
+			continuous = true;
+		} else if (!strcmp(argv[i], "--frame-times") && i + 1 < argc) {
+			frameTimesFile = argv[++i];
+		} else if (!strcmp(argv[i], "--headless")) {
+			headless = true;
+			continuous = true;
+		} else if (!strcmp(argv[i], "--png-dir") && i + 1 < argc) {
+			pngDir = argv[++i];
+		} else if (!strcmp(argv[i], "--png-every") && i + 1 < argc) {
+			pngEvery = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--startup-report")) {
+			startupReport = true;
+		} else if (!strcmp(argv[i], "--exit-after-startup")) {
+			exitAfterStartup = true;
+		} else if (!strcmp(argv[i], "--memory-report")) {
+			memoryReport = true;
+		} else {
+			cerr << "Unknown option " << argv[i] << endl;
+			return 1;
+		}
+	}
+	if (headless && pipelined) {
+		cerr << "--headless draws on the main thread; leave out --pipelined" << endl;
+		return 1;
+	}
+	if (!pngDir.empty() && !headless) {
+		cerr << "--png-dir needs --headless" << endl;
+		return 1;
+	}
+
 	// Database Initialization
+	sqlTrace.setEnabled(!sqlTraceFile.empty());
+	if (!traceFile.empty()) {
+		if (!tracer.open(traceFile)) {
+			cerr << "Can't write " << traceFile << endl;
+			return 1;
+		}
+		tracer.nameThread("main");
+	}
+	// Recording and replaying both run on a fresh copy of --db, so the
+	// snapshot stays as it is and every replay starts from the same data.
+	// So does a headless workload. A headless startup (--exit-after-startup)
+	// opens --db itself and does what a normal launch does to it: creates the
+	// schema if it is missing and moves previous years out into archives.
+	bool session = !recordFile.empty() || !replayFile.empty() || (headless && !exitAfterStartup);
+	InputRecorder recorder;
+	InputReplay replay;
+	unique_ptr<UiScript> script; // headless without a recording
+	if (!recordFile.empty() && !recorder.open(recordFile)) {
+		cerr << "Can't write " << recordFile << endl;
+		return 1;
+	}
+	if (!replayFile.empty() && !replay.open(replayFile)) {
+		cerr << "Can't read a recording from " << replayFile << endl;
+		return 1;
+	}
+	if (headless && replayFile.empty() && !exitAfterStartup) {
+		script = make_unique<UiScript>();
+	}
+	FrameReport report;
+	report.reserve(script ? script->frames() : replay.frames());
+	if (session) {
+		string snapshot = dbPath;
+		dbPath += ".session";
+		if (copyDatabase(snapshot.c_str(), dbPath.c_str()) != SQLITE_OK) {
+			cerr << "Can't copy " << snapshot << " to " << dbPath << endl;
+			return 1;
+		}
+	}
+
 	sqlite3 *db;
-	int rc = sqlite3_open("data.db", &db);
+	int rc = openDatabase(dbPath.c_str(), &db);
 	if (rc) {
 		cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
 		return 1;
 	}
+	startup.mark("sqlite3_open");
+
+	createSchema(db);
+	startup.mark("schema");
 
-	runCommand(db, "CREATE TABLE IF NOT EXISTS purchases ("
-	                    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-	                    "name TEXT,"
-	                    "quantity REAL,"
-	                    "price REAL,"
-	                    "timeStamp TEXT,"
-	                    "type TEXT"
-	                ");");
-
-	// GLFW Initialization
-	glfwInit();
+	// Previous years move out into read-only archives. A session's copy
+	// shares the real archives through its registry, so it leaves them alone
+	// and only reads them.
+	ShardSet shards(db, dbPath, archiveDir);
+	if (!session) {
+		shards.archiveOldYears();
+	}
+	if (!shards.attach()) {
+		return 1;
+	}
+	startup.mark("archives");
+
+	// Inserts and deletes are committed in batches by a background writer
+	WriteQueue writes(db);
+	// A session loads the whole list in the frame it starts in, so a replay
+	// sees the same rows on the same frame as the recording did
+	PurchaseLoader loader(32, session ? chrono::hours(24) : chrono::microseconds(2000));
+	startup.mark("writer thread");
+
+	// GLFW Initialization. Headless runs need no display: GLFW's null
+	// platform with an invisible window, whose context comes from EGL
+	// (surfaceless, e.g. Mesa llvmpipe) or else OSMesa
+#if GLFW_VERSION_MAJOR > 3 || GLFW_VERSION_MINOR >= 4
+	if (headless && glfwPlatformSupported(GLFW_PLATFORM_NULL)) {
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	}
+#endif
+	if (!glfwInit()) {
+		cerr << "Can't initialize GLFW" << endl;
+		return 1;
+	}
+	startup.mark("glfwInit");
 	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	GLFWwindow* win = glfwCreateWindow(1300, 700, "Buyer Notes", nullptr, nullptr);
+	GLFWwindow* win;
+	if (headless) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+		win = glfwCreateWindow(1300, 700, "Buyer Notes", nullptr, nullptr);
+		if (!win) {
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+			win = glfwCreateWindow(1300, 700, "Buyer Notes", nullptr, nullptr);
+		}
+	} else {
+		win = glfwCreateWindow(1300, 700, "Buyer Notes", nullptr, nullptr);
+	}
+	if (!win) {
+		cerr << "Can't create a" << (headless ? "n offscreen" : "") << " GL context" << endl;
+		glfwTerminate();
+		return 1;
+	}
 	glfwMakeContextCurrent(win);
-	glfwSwapInterval(1); // V-sync
+	int swapInterval = replay.frames() || headless ? 0 : 1; // V-sync, except when timing frames
+	glfwSwapInterval(swapInterval);
+
+	// A surfaceless context has no default framebuffer, so headless frames
+	// are drawn into one of our own, left bound throughout
+	GLuint offscreen = 0, offscreenColor = 0;
+	int offscreenWidth = 0, offscreenHeight = 0;
+	if (headless) {
+		glfwGetFramebufferSize(win, &offscreenWidth, &offscreenHeight);
+		glGenRenderbuffers(1, &offscreenColor);
+		glBindRenderbuffer(GL_RENDERBUFFER, offscreenColor);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, offscreenWidth, offscreenHeight);
+		glGenFramebuffers(1, &offscreen);
+		glBindFramebuffer(GL_FRAMEBUFFER, offscreen);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColor);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			cerr << "Can't draw into an offscreen framebuffer" << endl;
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glDeleteFramebuffers(1, &offscreen);
+			glDeleteRenderbuffers(1, &offscreenColor);
+			glfwDestroyWindow(win);
+			glfwTerminate();
+			return 1;
+		}
+		cerr << "Headless: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << endl;
+	}
+	startup.mark("window and context");
+	if (!pngDir.empty()) {
+		error_code error;
+		filesystem::create_directories(pngDir, error);
+	}
+	vector<uint8_t> pixels;
+	auto writeFramebuffer = [&](const string& name) {
+		pixels.resize((size_t) offscreenWidth * offscreenHeight * 4);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, offscreenWidth, offscreenHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		string path = pngDir + "/" + name + ".png";
+		if (!writePng(path, offscreenWidth, offscreenHeight, pixels)) {
+			cerr << "Can't write " << path << endl;
+		}
+	};
 
 	// Init Nuklear GLFW wrapper
 	struct nk_glfw glfw = {};
+	glfw.upload = upload;
+	glfw.retained = retained;
 	nk_glfw3_init(&glfw, win, (nk_glfw_init_state) 1);
+	startup.mark("nk_glfw3_init");
+
+	// The backend reports its convert, upload and draw phases to the profiler
+	profiler.attachThread();
+	profiler.setEnabled(profile);
+	glfw.profile = [](void *, enum nk_glfw_phase phase, int begin) {
+		const FrameProfiler::Scope scopes[] = {FrameProfiler::Convert, FrameProfiler::Upload, FrameProfiler::Draw};
+		if (begin) {
+			profiler.begin(scopes[phase]);
+		} else {
+			profiler.end();
+		}
+	};
+	// Sessions hook in between gathering a frame's input and handing it to Nuklear
+	if (recorder.isOpen()) {
+		glfw.input = [](void *user, struct nk_glfw_input *in) {
+			static_cast<InputRecorder*>(user)->record(*in);
+		};
+		glfw.input_user = &recorder;
+	} else if (!replayFile.empty()) {
+		glfw.input = [](void *user, struct nk_glfw_input *in) {
+			static_cast<InputReplay*>(user)->next(*in);
+		};
+		glfw.input_user = &replay;
+	} else if (script) {
+		glfw.input = [](void *user, struct nk_glfw_input *in) {
+			static_cast<UiScript*>(user)->next(*in);
+		};
+		glfw.input_user = script.get();
+	}
 	struct nk_colorf bg = {0.10f, 0.18f, 0.24f, 1.0f};
 
 	// Load fonts
@@ -63,6 +323,7 @@ int main() {
 	struct nk_font *bigFont = nk_font_atlas_add_default(atlas, 18.0f, nullptr);
 	nk_glfw3_font_stash_end(&glfw);
 	nk_style_set_font(&glfw.ctx, &bigFont->handle);
+	startup.mark("font baking");
 
 	// Style window headers
 	glfw.ctx.style.window.header.label_normal = nk_rgba(120, 255, 255, 255);
@@ -70,23 +331,112 @@ int main() {
 	glfw.ctx.style.window.header.normal = nk_style_item_color(nk_rgba(0, 0, 0, 255));
 	glfw.ctx.style.window.header.active = nk_style_item_color(nk_rgba(20, 20, 20, 255));
 
+	// Pipelined mode hands the GL context to a render thread from here on
+	unique_ptr<FramePipeline> pipeline;
+	if (pipelined) {
+		pipeline = make_unique<FramePipeline>(&glfw, bg, swapInterval);
+	}
+
+	// Frames are only drawn on input, data changes and timers
+	FrameScheduler scheduler(!continuous);
+	writes.setCommitListener([&scheduler] { scheduler.requestFrame(); });
+
+	// Other processes writing data.db bypass the write queue
+	long long dataVersion = writes.read(getDataVersion);
+	unsigned long externalChanges = 0;
+	scheduler.poll(1.0, [&] {
+		long long version = writes.read(getDataVersion);
+		if (version == dataVersion) {
+			return false;
+		}
+		dataVersion = version;
+		externalChanges++;
+		loader.invalidate();
+		return true;
+	});
+
 	// Global variables
 	int selectedIndex = -1;
+	string writeError; // why queued writes are not reaching the database
 	enum class SelectionType { None, Name, Type, Date, Row } selectionType = SelectionType::None;
 	string selectedValue = "";
 	int focusedField = 0; // 0 = Name, 1 = Type, 2 = Quantity, 3 = Price
 
+	// Statistics window values and what they were computed for
+	struct {
+		double totalLeft, totalLastMonth, avgPerDayLastMonth;
+		double groupSpent, groupQuantity, groupAveragePrice;
+		int groupUniqueItems;
+
+		bool valid;
+		unsigned long version;
+		long day;
+		SelectionType selectionType;
+		string selectedValue;
+	} stats = {};
+
+	// Per-frame label text, recycled when the backend is done with a frame
+	FrameArena frame;
+	glfw.frame_end = [](void *arena) { static_cast<FrameArena*>(arena)->reset(); };
+	glfw.frame_end_user = &frame;
+
 	// Main loop
+	unsigned long frameCount = 0;
+	unsigned long allocatingFrames = 0;
+	unsigned long idleFrames = 0;
+	unsigned long framesOverBudget = 0;
+	AllocCounts lastFrameHeap;
+	allocSites.setEnabled(debugAllocations || allocBudget >= 0);
+	bool profileKeyDown = false;
+	bool showSqlTrace = sqlTrace.enabled();
+	bool sqlTraceKeyDown = false;
+	vector<SqlTrace::Row> sqlTraceRows;
+	bool traceKeyDown = false;
 	while (!glfwWindowShouldClose(win)) {
-		// Poll events and start a new frame
-		glfwPollEvents();
+		// Wait for something to draw and start a new frame
+		scheduler.wait();
+		if ((!replayFile.empty() && replay.done()) || (script && script->done())) {
+			break;
+		}
+		auto frameStart = chrono::steady_clock::now();
+		profiler.beginFrame();
+		AllocCounts heapBefore = AllocCounts::now();
+		if (allocSites.enabled()) {
+			allocSites.clear();
+		}
+		bool idle = frameCount > 0 && loader.isIdle(writes);
 		nk_glfw3_new_frame(&glfw);
+		idle = !scheduler.noteInput(glfw.ctx.input) && idle;
+		scheduler.wakeAt(glfwGetTime() + secondsUntilNextDay());
 
-		// Load purchases
-		vector<Purchase> purchases = loadPurchases(db);
+		// F12 shows and hides the profiler; it only records while shown
+		bool profileKey = glfwGetKey(win, GLFW_KEY_F12) == GLFW_PRESS;
+		if (profileKey && !profileKeyDown) {
+			profiler.setEnabled(!profiler.enabled());
+		}
+		profileKeyDown = profileKey;
+		bool sqlTraceKey = glfwGetKey(win, GLFW_KEY_F11) == GLFW_PRESS;
+		if (sqlTraceKey && !sqlTraceKeyDown) {
+			showSqlTrace = !showSqlTrace && sqlTrace.enabled();
+		}
+		sqlTraceKeyDown = sqlTraceKey;
+		if (sqlTrace.enabled()) {
+			sqlTrace.noteFrame();
+		}
+		bool layout = profiler.begin(FrameProfiler::Layout);
+
+		// Load purchases (streamed in over several frames after a change)
+		{
+			ProfileScope scope(FrameProfiler::DB);
+			loader.pump(writes);
+		}
+		const vector<Purchase>& purchases = loader.purchases();
+		if (loader.isLoading()) {
+			scheduler.requestFrame();
+		}
 
 		// Purchases Window (Left Side)
-		if (nk_begin(&glfw.ctx, "Purchases", nk_rect(0, 0, 750, 700), NK_WINDOW_BORDER | NK_WINDOW_TITLE)) {
+		if (nk_begin(&glfw.ctx, "Purchases", nk_rect(0, 0, 750, 700), NK_WINDOW_BORDER | NK_WINDOW_TITLE | NK_WINDOW_NO_SCROLLBAR)) {
 			float widths[] = {0.25f, 0.2f, 0.1f, 0.15f, 0.15f, 0.15f};
 		
 			// Header row
@@ -100,101 +450,119 @@ int main() {
 			nk_label(&glfw.ctx, "Total", NK_TEXT_LEFT);
 			nk_style_pop_color(&glfw.ctx);
 			
-			// Data rows
-			for (size_t i = 0; i < purchases.size(); ++i) {
-				nk_layout_row(&glfw.ctx, NK_DYNAMIC, 25, 6, widths);
-				struct nk_command_buffer* buf = nk_window_get_canvas(&glfw.ctx);
-				const Purchase& p = purchases[i];
-			
-				// Full row bounds
-				struct nk_rect cellBounds = nk_widget_bounds(&glfw.ctx);
-				struct nk_rect rowBounds = nk_rect(cellBounds.x, cellBounds.y, 750, cellBounds.h);
-			
-				// Determine if row is highlighted
-				bool highlightRow = 
-					(selectionType == SelectionType::Name && p.name == selectedValue) ||
-					(selectionType == SelectionType::Type && p.type == selectedValue) ||
-					(selectionType == SelectionType::Date && p.timeStamp.substr(0, 10) == selectedValue) ||
-					(selectionType == SelectionType::Row && selectedIndex == (int) i);
-			
-				// Hover highlight
-				if (nk_input_is_mouse_hovering_rect(&glfw.ctx.input, rowBounds)) {
-					nk_fill_rect(buf, rowBounds, 0, nk_rgba(60, 60, 60, 255));
-				}
-			
-				// Selection highlight
-				if (highlightRow) {
-					nk_fill_rect(buf, rowBounds, 0, nk_rgba(120, 120, 120, 255));
-				}
-			
-				// ---- NAME CELL ----
-				struct nk_rect nameBounds = nk_widget_bounds(&glfw.ctx);
-				if (nk_input_is_mouse_click_in_rect(&glfw.ctx.input, NK_BUTTON_RIGHT, nameBounds)) {
-					selectionType = SelectionType::Name;
-					selectedValue = p.name;
-					selectedIndex = -1;
+			// Data rows: the list view only asks for the rows in sight and
+			// reserves the height of the rest, so this costs the same at any size
+			const int rowHeight = 25;
+			float listHeight = nk_window_get_content_region(&glfw.ctx).h - 15 - glfw.ctx.style.window.spacing.y;
+			nk_layout_row_dynamic(&glfw.ctx, listHeight, 1);
+			struct nk_list_view view;
+			if (nk_list_view_begin(&glfw.ctx, &view, "Purchase rows", 0, rowHeight, (int) purchases.size())) {
+				// Hit testing happens once for the whole table, not per cell
+				TableHitTest hits(&glfw.ctx, widths, 6, rowHeight, view.begin, view.count);
+
+				// RIGHT CLICK on a name, type or date selects everything sharing it
+				TableHit rightClick = hits.clicked(NK_BUTTON_RIGHT);
+				if (rightClick.row >= 0) {
+					const Purchase& p = purchases[rightClick.row];
+					if (rightClick.column == 0) {
+						selectionType = SelectionType::Name;
+						selectedValue = p.name;
+						selectedIndex = -1;
+					} else if (rightClick.column == 1) {
+						selectionType = SelectionType::Type;
+						selectedValue = p.type;
+						selectedIndex = -1;
+					} else if (rightClick.column == 4) {
+						selectionType = SelectionType::Date;
+						selectedValue = p.timeStamp.substr(0, 10);
+						selectedIndex = -1;
+					}
 				}
-				nk_label(&glfw.ctx, p.name.c_str(), NK_TEXT_LEFT);
-			
-				// ---- TYPE CELL ----
-				struct nk_rect typeBounds = nk_widget_bounds(&glfw.ctx);
-				if (nk_input_is_mouse_click_in_rect(&glfw.ctx.input, NK_BUTTON_RIGHT, typeBounds)) {
-					selectionType = SelectionType::Type;
-					selectedValue = p.type;
-					selectedIndex = -1;
+
+				// LEFT CLICK on row selects individual row
+				TableHit leftClick = hits.clicked(NK_BUTTON_LEFT);
+				if (leftClick.row >= 0) {
+					selectionType = SelectionType::Row;
+					selectedIndex = leftClick.row;
+					selectedValue = "";
 				}
-				nk_label(&glfw.ctx, p.type.c_str(), NK_TEXT_LEFT);
+
+				// Cell text comes pre-formatted from the table model
+				const PurchaseTable& table = loader.table();
+				for (size_t i = view.begin; i < (size_t) view.end; ++i) {
+					nk_layout_row(&glfw.ctx, NK_DYNAMIC, rowHeight, 6, widths);
+					struct nk_command_buffer* buf = nk_window_get_canvas(&glfw.ctx);
+					const Purchase& p = table[i];
+					struct nk_rect rowBounds = hits.rowBounds(i);
+					const char *date = table.cell(i, PurchaseTable::Date);
 			
-				// ---- QUANTITY CELL ----
-				string qtyStr = formatDouble(p.quantity);
-				nk_label(&glfw.ctx, qtyStr.c_str(), NK_TEXT_LEFT);
+					// Determine if row is highlighted
+					bool highlightRow = 
+						(selectionType == SelectionType::Name && p.name == selectedValue) ||
+						(selectionType == SelectionType::Type && p.type == selectedValue) ||
+						(selectionType == SelectionType::Date && selectedValue == date) ||
+						(selectionType == SelectionType::Row && selectedIndex == (int) i);
 			
-				// ---- PRICE CELL ----
-				string priceStr = formatDouble(p.price * p.quantity);
-				nk_label(&glfw.ctx, priceStr.c_str(), NK_TEXT_LEFT);
+					// Hover highlight
+					if (hits.hovered().row == (int) i) {
+						nk_fill_rect(buf, rowBounds, 0, nk_rgba(60, 60, 60, 255));
+					}
 			
-				// ---- DATE CELL ----
-				struct nk_rect dateBounds = nk_widget_bounds(&glfw.ctx);
-				string dateStr = p.timeStamp.substr(0, 10);
-				if (nk_input_is_mouse_click_in_rect(&glfw.ctx.input, NK_BUTTON_RIGHT, dateBounds)) {
-					selectionType = SelectionType::Date;
-					selectedValue = dateStr;
-					selectedIndex = -1;
-				}
-				nk_label(&glfw.ctx, dateStr.c_str(), NK_TEXT_LEFT);
+					// Selection highlight
+					if (highlightRow) {
+						nk_fill_rect(buf, rowBounds, 0, nk_rgba(120, 120, 120, 255));
+					}
 			
-				// ---- TOTAL CELL ----
-				bool lastOfDay = (i == 0) || (dateStr != purchases[i - 1].timeStamp.substr(0, 10));
-				if (lastOfDay) {
-					nk_label(&glfw.ctx, formatDouble(getTotalSpentOnDate(db, p.timeStamp)).c_str(), NK_TEXT_LEFT);
-				} else {
-					nk_label(&glfw.ctx, "", NK_TEXT_LEFT);
-				}
-			
-				// LEFT CLICK on row selects individual row
-				if (nk_input_is_mouse_click_in_rect(&glfw.ctx.input, NK_BUTTON_LEFT, rowBounds)) {
-					selectionType = SelectionType::Row;
-					selectedIndex = i;
-					selectedValue = "";
+					// Name, type, quantity, total, date and the day's total
+					for (int column = 0; column < PurchaseTable::Columns; ++column) {
+						nk_label(&glfw.ctx, table.cell(i, (PurchaseTable::Column) column), NK_TEXT_LEFT);
+					}
 				}
+				nk_list_view_end(&view);
 			}
 		}
 		nk_end(&glfw.ctx);
 		
+		// Statistics are queried again only when the data, the selection or
+		// the day changes
+		long day = (long) (time(nullptr) / 86400);
+		unsigned long version = writes.version() + externalChanges;
+		if (!stats.valid || version != stats.version || day != stats.day ||
+			selectionType != stats.selectionType || selectedValue != stats.selectedValue) {
+			writes.read([&](sqlite3 *db) {
+				ProfileScope scope(FrameProfiler::DB);
+				stats.totalLeft = -shards.totalSpent();
+				stats.totalLastMonth = shards.totalSpent(30);
+				stats.avgPerDayLastMonth = shards.averageSpentPerDay(30);
+
+				if (selectionType == SelectionType::Name) {
+					stats.groupSpent = shards.totalSpent(selectedValue, 30);
+					stats.groupQuantity = shards.totalQuantity(selectedValue, 30);
+					stats.groupAveragePrice = stats.groupQuantity ? stats.groupSpent / stats.groupQuantity : 0;
+				} else if (selectionType == SelectionType::Type) {
+					stats.groupSpent = shards.totalSpentByType(selectedValue, 30);
+					// Distinct names don't add up per shard; the view costs each
+					// archive one index probe
+					stats.groupUniqueItems = getUniqueItemsByTypeLast30Days(db, selectedValue);
+				} else if (selectionType == SelectionType::Date) {
+					stats.groupSpent = shards.totalSpentOnDate(selectedValue);
+					stats.groupUniqueItems = getUniqueItemsOnDate(db, selectedValue);
+				}
+			});
+			stats.valid = true;
+			stats.version = version;
+			stats.day = day;
+			stats.selectionType = selectionType;
+			stats.selectedValue = selectedValue;
+		}
+
 		// Statistics Window (Right Side)
 		if (nk_begin(&glfw.ctx, "Statistics", nk_rect(750, 0, 550, 400), NK_WINDOW_BORDER | NK_WINDOW_TITLE)) {
 			nk_layout_row_dynamic(&glfw.ctx, 25, 1);
-		
-			double totalLastMonth = getTotalSpent(db, 30);
-			double avgPerDayLastMonth = getAverageSpentPerDayLastMonth(db);
-
-			string totalStr          = "Total left                          : " + formatDouble(-getTotalSpent(db)) + " EGP";
-			string totalLastMonthStr = "Total spent last month              : " + formatDouble(totalLastMonth) + " EGP";
-			string avgStr            = "Average spent per day last month    : " + formatDouble(avgPerDayLastMonth) + " EGP";
 
-			nk_label(&glfw.ctx, totalStr.c_str(), NK_TEXT_LEFT);
-			nk_label(&glfw.ctx, totalLastMonthStr.c_str(), NK_TEXT_LEFT);
-			nk_label(&glfw.ctx, avgStr.c_str(), NK_TEXT_LEFT);
+			nk_label(&glfw.ctx, frame.concat("Total left                          : ", frame.number(stats.totalLeft), " EGP"), NK_TEXT_LEFT);
+			nk_label(&glfw.ctx, frame.concat("Total spent last month              : ", frame.number(stats.totalLastMonth), " EGP"), NK_TEXT_LEFT);
+			nk_label(&glfw.ctx, frame.concat("Average spent per day last month    : ", frame.number(stats.avgPerDayLastMonth), " EGP"), NK_TEXT_LEFT);
 
 			// Show purchase-specific stats only if Row mode is active and a row is selected
 			if (selectionType == SelectionType::Row && selectedIndex >= 0 && selectedIndex < (int) purchases.size()) {
@@ -205,19 +573,12 @@ int main() {
 				nk_label(&glfw.ctx, "Selected Purchase Stats:", NK_TEXT_LEFT);
 				nk_style_pop_color(&glfw.ctx);
 			
-				string itemStr  = "Name       : " + selected.name;
-				string typeStr  = "Type       : " + selected.type;
-				string qtyStr   = "Quantity   : " + formatDouble(selected.quantity);
-				string priceStr = "Unit Price : " + formatDouble(selected.price) + " EGP";
-				string totalStr = "Total Cost : " + formatDouble(selected.price * selected.quantity) + " EGP";
-				string dateStr  = "Date       : " + selected.timeStamp.substr(0, 10);
-			
-				nk_label(&glfw.ctx, itemStr.c_str(), NK_TEXT_LEFT);
-				nk_label(&glfw.ctx, typeStr.c_str(), NK_TEXT_LEFT);
-				nk_label(&glfw.ctx, qtyStr.c_str(), NK_TEXT_LEFT);
-				nk_label(&glfw.ctx, priceStr.c_str(), NK_TEXT_LEFT);
-				nk_label(&glfw.ctx, totalStr.c_str(), NK_TEXT_LEFT);
-				nk_label(&glfw.ctx, dateStr.c_str(), NK_TEXT_LEFT);
+				nk_label(&glfw.ctx, frame.concat("Name       : ", selected.name), NK_TEXT_LEFT);
+				nk_label(&glfw.ctx, frame.concat("Type       : ", selected.type), NK_TEXT_LEFT);
+				nk_label(&glfw.ctx, frame.concat("Quantity   : ", frame.number(selected.quantity)), NK_TEXT_LEFT);
+				nk_label(&glfw.ctx, frame.concat("Unit Price : ", frame.number(selected.price), " EGP"), NK_TEXT_LEFT);
+				nk_label(&glfw.ctx, frame.concat("Total Cost : ", frame.number(selected.price * selected.quantity), " EGP"), NK_TEXT_LEFT);
+				nk_label(&glfw.ctx, frame.concat("Date       : ", loader.table().cell(selectedIndex, PurchaseTable::Date)), NK_TEXT_LEFT);
 			
 				// Delete Button
 				nk_style_push_style_item(&glfw.ctx, &glfw.ctx.style.button.normal, nk_style_item_color(nk_rgba(200, 50, 50, 255)));
@@ -225,7 +586,7 @@ int main() {
 				nk_style_push_style_item(&glfw.ctx, &glfw.ctx.style.button.active, nk_style_item_color(nk_rgba(180, 30, 30, 255)));
 			
 				if (nk_button_label(&glfw.ctx, "Delete Selected")) {
-					deletePurchase(db, selected.id);
+					writes.deletePurchase(selected.id);
 					selectedIndex = -1;
 					selectionType = SelectionType::None;
 					selectedValue = "";
@@ -243,49 +604,21 @@ int main() {
 				nk_label(&glfw.ctx, "Selected Group Stats:", NK_TEXT_LEFT);
 				nk_style_pop_color(&glfw.ctx);
 			
-				double totalSpent = 0;
-				double totalQty = 0;
-				double avgPrice = 0;
-				int uniqueItems = 0;
-				string traitStr;
-			
 				if (selectionType == SelectionType::Name) {
-					totalSpent = getTotalSpent(db, selectedValue, 30);
-					totalQty = getTotalQuantity(db, selectedValue, 30);
-					avgPrice = getAveragePrice(db, selectedValue, 30);
-
-					traitStr         = "Name                                : " + selectedValue;
-					nk_label(&glfw.ctx, traitStr.c_str(), NK_TEXT_LEFT);
-				
-					string qtyStr    = "Total quantity bought (last 30 days): " + formatDouble(totalQty);
-					nk_label(&glfw.ctx, qtyStr.c_str(), NK_TEXT_LEFT);
-					
-					string avgStr    = "Average unit price (last 30 days)   : " + formatDouble(avgPrice) + " EGP";
-					nk_label(&glfw.ctx, avgStr.c_str(), NK_TEXT_LEFT);
+					nk_label(&glfw.ctx, frame.concat("Name                                : ", selectedValue), NK_TEXT_LEFT);
+					nk_label(&glfw.ctx, frame.concat("Total quantity bought (last 30 days): ", frame.number(stats.groupQuantity)), NK_TEXT_LEFT);
+					nk_label(&glfw.ctx, frame.concat("Average unit price (last 30 days)   : ", frame.number(stats.groupAveragePrice), " EGP"), NK_TEXT_LEFT);
 				
 				} else if (selectionType == SelectionType::Type) {
-					totalSpent = getTotalSpentByType(db, selectedValue, 30);
-					int uniqueItems = getUniqueItemsByTypeLast30Days(db, selectedValue);
-
-					traitStr         = "Type                                : " + selectedValue;
-					nk_label(&glfw.ctx, traitStr.c_str(), NK_TEXT_LEFT);
-				
-					string uniqueStr = "Unique items bought (last 30 days)  : " + to_string(uniqueItems);
-					nk_label(&glfw.ctx, uniqueStr.c_str(), NK_TEXT_LEFT);
+					nk_label(&glfw.ctx, frame.concat("Type                                : ", selectedValue), NK_TEXT_LEFT);
+					nk_label(&glfw.ctx, frame.concat("Unique items bought (last 30 days)  : ", frame.integer(stats.groupUniqueItems)), NK_TEXT_LEFT);
 				
 				} else if (selectionType == SelectionType::Date) {
-					totalSpent = getTotalSpentOnExactDate(db, selectedValue);
-					uniqueItems = getUniqueItemsOnDate(db, selectedValue);
-
-					traitStr         = "Date                                : " + selectedValue;
-					nk_label(&glfw.ctx, traitStr.c_str(), NK_TEXT_LEFT);
-				
-					string uniqueStr = "Unique items bought                 : " + to_string(uniqueItems);
-					nk_label(&glfw.ctx, uniqueStr.c_str(), NK_TEXT_LEFT);
+					nk_label(&glfw.ctx, frame.concat("Date                                : ", selectedValue), NK_TEXT_LEFT);
+					nk_label(&glfw.ctx, frame.concat("Unique items bought                 : ", frame.integer(stats.groupUniqueItems)), NK_TEXT_LEFT);
 				}
 			
-				string spentStr      = "Total spent (last 30 days)          : " + formatDouble(totalSpent) + " EGP";
-				nk_label(&glfw.ctx, spentStr.c_str(), NK_TEXT_LEFT);
+				nk_label(&glfw.ctx, frame.concat("Total spent (last 30 days)          : ", frame.number(stats.groupSpent), " EGP"), NK_TEXT_LEFT);
 			}
 		}
 		nk_end(&glfw.ctx);
@@ -319,22 +652,7 @@ int main() {
 			// Rebuild suggestions only when input changes
 			if (lastNameInput != nameInput) {
 			    lastNameInput = nameInput;
-			    nameSuggestions.clear();
-			    if (strlen(nameInput) > 0) {
-			        stringstream ss;
-			        ss << "SELECT DISTINCT name FROM purchases "
-			           << "WHERE LOWER(name) LIKE LOWER('" << nameInput << "%') "
-			           << "ORDER BY name COLLATE NOCASE "
-			           << "LIMIT 5;";
-			        sqlite3_stmt* stmt;
-			        if (sqlite3_prepare_v2(db, ss.str().c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
-			            while (sqlite3_step(stmt) == SQLITE_ROW) {
-			                const char* s = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-			                nameSuggestions.push_back(s);
-			            }
-			        }
-			        sqlite3_finalize(stmt);
-			    }
+			    nameSuggestions = writes.nameSuggestions(nameInput);
 			}
 			
 			// Draw suggestion list (max 5)
@@ -397,7 +715,7 @@ int main() {
 				double price = atof(priceInput) / quantity;
 		
 				if (strlen(nameInput) > 0 && quantity > 0 && strlen(priceInput) > 0) {
-					insert(db, nameInput, quantity, price, typeInput);
+					writes.insert(nameInput, quantity, price, typeInput);
 		
 					// Clear inputs
 					nameInput[0] = '\0';
@@ -415,20 +733,200 @@ int main() {
 			nk_style_pop_style_item(&glfw.ctx);
 			nk_style_pop_style_item(&glfw.ctx);
 			nk_style_pop_style_item(&glfw.ctx);
+
+			// Writes that failed to commit stay listed and are retried; say so
+			if (size_t unsaved = writes.failure(&writeError)) {
+				nk_layout_row_dynamic(&glfw.ctx, 25, 1);
+				nk_label_colored(&glfw.ctx, frame.concat(frame.integer((long) unsaved), " changes not saved yet: ", writeError),
+				                 NK_TEXT_LEFT, nk_rgba(255, 80, 80, 255));
+				nk_label_colored(&glfw.ctx, "They are kept, and retried every few seconds.",
+				                 NK_TEXT_LEFT, nk_rgba(255, 80, 80, 255));
+			}
 		}
 		nk_end(&glfw.ctx);
 
-		// Render
-		int width, height;
-		glfwGetFramebufferSize(win, &width, &height);
-		glViewport(0, 0, width, height);
-		glClearColor(bg.r, bg.g, bg.b, bg.a);
-		glClear(GL_COLOR_BUFFER_BIT);
-		nk_glfw3_render(&glfw, NK_ANTI_ALIASING_ON, 512 * 1024, 128 * 1024);
-		glfwSwapBuffers(win);
+		if (profiler.enabled()) {
+			drawProfilerOverlay(&glfw.ctx, profiler, lastFrameHeap, frame);
+		}
+		if (showSqlTrace) {
+			drawSqlTraceOverlay(&glfw.ctx, sqlTrace, sqlTraceRows, frame, sqlTraceFile);
+		}
+		if (layout) {
+			profiler.end();
+		}
+
+		// Render, unless the frame would look exactly like the one on screen
+		bool drawn = !nk_glfw3_skip_frame(&glfw, NK_ANTI_ALIASING_ON);
+		if (!drawn) {
+			scheduler.frameSkipped();
+		} else if (pipeline) {
+			struct nk_glfw_frame *frame = pipeline->acquire();
+			nk_glfw3_convert(&glfw, frame, NK_ANTI_ALIASING_ON);
+			pipeline->present(frame);
+		} else {
+			int width, height;
+			glfwGetFramebufferSize(win, &width, &height);
+			glViewport(0, 0, width, height);
+			glClearColor(bg.r, bg.g, bg.b, bg.a);
+			glClear(GL_COLOR_BUFFER_BIT);
+			nk_glfw3_render(&glfw, NK_ANTI_ALIASING_ON, 0, 0); // buffers grow to the largest frame
+			ProfileScope scope(FrameProfiler::Swap);
+			if (headless) {
+				glFinish(); // nothing to present; count the rasterizing in the frame
+			} else {
+				glfwSwapBuffers(win);
+			}
+		}
+		profiler.endFrame();
+		if (!replayFile.empty() || script) {
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count();
+			if (pipeline) {
+				report.note(ms, drawn); // the render thread owns the stats
+			} else {
+				report.note(ms, drawn, glfw.stats.vertices, glfw.stats.elements, glfw.stats.draw_calls);
+			}
+		}
+		if (!pngDir.empty() && pngEvery > 0 && (frameCount + 1) % pngEvery == 0) {
+			writeFramebuffer("frame-" + to_string(frameCount + 1));
+		}
+
+		// F10 writes out the trace so far; it is also written whenever a
+		// thread's buffer fills halfway
+		bool traceKey = glfwGetKey(win, GLFW_KEY_F10) == GLFW_PRESS;
+		if (tracer.enabled() && ((traceKey && !traceKeyDown) || tracer.needsFlush())) {
+			TraceSpan span("trace", "Flush");
+			tracer.flush();
+		}
+		traceKeyDown = traceKey;
+
+		// Once loaded and idle, a frame should not allocate at all
+		frameCount++;
+		lastFrameHeap = AllocCounts::now() - heapBefore;
+		idle = idle && loader.isIdle(writes);
+		idleFrames += idle;
+		bool overBudget = idle && allocBudget >= 0 && lastFrameHeap.allocations > (unsigned long) allocBudget;
+		framesOverBudget += overBudget;
+		if (lastFrameHeap.allocations) {
+			allocatingFrames++;
+			if (debugAllocations || overBudget) {
+				cerr << "Frame " << frameCount << (idle ? " (idle): " : ": ") << lastFrameHeap.allocations
+					 << " heap allocations of " << lastFrameHeap.bytes << " bytes, " << lastFrameHeap.frees << " frees, "
+					 << frame.peakUsed() << " arena bytes at peak" << endl;
+				allocSites.print(cerr, 5, "    ");
+			}
+		}
+
+		// Startup ends with the first frame that shows the whole list
+		if (!startup.finished()) {
+			if (frameCount == 1) {
+				startup.mark("first frame");
+			}
+			if (loader.isIdle(writes)) {
+				startup.finish("rest of the list");
+				if (startupReport) {
+					startup.print(cout);
+					cout << "  " << purchases.size() << " purchases loaded" << endl;
+				}
+				if (exitAfterStartup) {
+					break;
+				}
+			}
+		}
 	}
 
+	// Stops the render thread, so its stats (and its last frames' trace
+	// events) are final and the GL context is back on this thread
+	pipeline.reset();
+
+	if (renderStats) {
+		const char *paths[] = {"auto", "persistent", "map-range", "orphan"};
+		cerr << "upload " << paths[glfw.ogl.upload] << ": " << glfw.stats.frames << " frames, "
+			 << fixed << setprecision(3) << glfw.stats.render_ms_total / max(glfw.stats.frames, 1ul)
+			 << " ms render CPU per frame (" << glfw.stats.upload_ms_total / max(glfw.stats.frames, 1ul)
+			 << " ms upload), " << glfw.stats.fence_waits << " fence waits, "
+			 << glfw.stats.skipped_frames << " unchanged frames skipped" << endl;
+		cerr << "geometry peak " << glfw.stats.vertex_peak / 1024 << " KB vertices, "
+			 << glfw.stats.element_peak / 1024 << " KB elements; ring slots "
+			 << glfw.ogl.slot_vertex_size / 1024 << " KB + " << glfw.ogl.slot_element_size / 1024
+			 << " KB after " << glfw.stats.buffer_grows << " grows" << endl;
+		cerr << "last frame " << glfw.stats.draw_commands << " draw commands in " << glfw.stats.draw_calls
+			 << " draw calls, " << (double) glfw.stats.draw_calls_total / max(glfw.stats.frames, 1ul)
+			 << " calls per frame on average" << endl;
+		if (glfw.retained && !pipelined) {
+			cerr << "last frame " << glfw.stats.windows_converted << " windows converted, "
+				 << glfw.stats.windows_reused << " reused" << endl;
+		}
+	}
+	if (recorder.isOpen()) {
+		recorder.close();
+		cerr << "Recorded " << recorder.frames() << " frames to " << recordFile << endl;
+	}
+	if (!replayFile.empty() || script) {
+		report.print(cout, replayFile.empty() ? "scripted" : "replayed");
+		if (!frameTimesFile.empty() && !report.writeCsv(frameTimesFile)) {
+			cerr << "Can't write " << frameTimesFile << endl;
+		}
+	}
+	if (!pngDir.empty()) {
+		writeFramebuffer("last");
+		cerr << "Framebuffers written to " << pngDir << endl;
+	}
+	if (sqlTrace.enabled()) {
+		if (sqlTrace.writeDump(sqlTraceFile)) {
+			cerr << "SQL trace written to " << sqlTraceFile << endl;
+		} else {
+			cerr << "Can't write " << sqlTraceFile << endl;
+		}
+	}
+	if (tracer.enabled()) {
+		unsigned long dropped = tracer.close();
+		cerr << "Trace written to " << traceFile;
+		if (dropped) {
+			cerr << " (" << dropped << " events dropped, buffers full)";
+		}
+		cerr << endl;
+	}
+	if (memoryReport) {
+		ProcessMemory process = ProcessMemory::now();
+		SqliteMemory sqlite = SqliteMemory::now();
+		int pageCache = 0, unused;
+		writes.read([&](sqlite3 *db) { sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_USED, &pageCache, &unused, 0); });
+		struct nk_glfw_memory nuklear;
+		nk_glfw3_memory(&glfw, &nuklear);
+		const PurchaseTable& table = loader.table();
+		PurchaseTable::Footprint footprint = table.footprint();
+
+		// Per purchase where the size scales with the history
+		MemoryReport memory;
+		memory.add("RSS", process.rss, table.size());
+		memory.add("RSS peak", process.peakRss, table.size());
+		memory.add("SQLite", sqlite.used, table.size());
+		memory.add("SQLite high water", sqlite.peak, table.size());
+		memory.add("SQLite page cache", pageCache, table.size());
+		memory.add("Purchase structs", footprint.purchases, table.size());
+		memory.add("Purchase strings", footprint.strings, table.size());
+		memory.add("Table cell offsets", footprint.cells, table.size());
+		memory.add("Table cell text", footprint.text, table.size());
+		memory.add("Nuklear context", nuklear.context);
+		memory.add("Nuklear conversion", nuklear.converted);
+		memory.add("GL vertex buffers", nuklear.gl_buffers);
+		memory.add("Frame arena", frame.capacity());
+		memory.print(cout);
+		cout << "  " << table.size() << " purchases" << endl;
+	}
+	if (debugAllocations) {
+		cerr << allocatingFrames << " of " << frameCount << " frames allocated" << endl;
+	}
+	if (allocBudget >= 0) {
+		cerr << framesOverBudget << " of " << idleFrames << " idle frames made more than " << allocBudget
+			 << " allocations" << endl;
+	}
+
+	if (offscreen) {
+		glDeleteFramebuffers(1, &offscreen);
+		glDeleteRenderbuffers(1, &offscreenColor);
+	}
 	nk_glfw3_shutdown(&glfw);
 	glfwTerminate();
-	return 0;
+	return framesOverBudget ? 1 : 0;
 }
@@ -0,0 +1,94 @@
+#ifndef MEMORY_STATS_HPP
+#define MEMORY_STATS_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <ostream>
+#include <sqlite3.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+// Resident set size from /proc/self/status, now and at its peak (VmRSS,
+// VmHWM). Reads into a stack buffer, so it can run every frame without
+// touching the heap; zeros where /proc is missing.
+struct ProcessMemory {
+	size_t rss = 0, peakRss = 0;
+
+	static ProcessMemory now() {
+		ProcessMemory memory;
+		int fd = open("/proc/self/status", O_RDONLY);
+		if (fd < 0) {
+			return memory;
+		}
+		char status[4096];
+		ssize_t length = read(fd, status, sizeof(status) - 1);
+		close(fd);
+		status[length > 0 ? length : 0] = '\0';
+		memory.rss = field(status, "VmRSS:");
+		memory.peakRss = field(status, "VmHWM:");
+		return memory;
+	}
+
+private:
+	// "VmRSS:	   52316 kB" -> bytes
+	static size_t field(const char *status, const char *name) {
+		const char *line = strstr(status, name);
+		return line ? strtoull(line + strlen(name), nullptr, 10) * 1024 : 0;
+	}
+};
+
+// Everything SQLite has allocated, across connections, and its high-water
+// mark; the page cache is most of it
+struct SqliteMemory {
+	sqlite3_int64 used = 0, peak = 0;
+
+	static SqliteMemory now() {
+		SqliteMemory memory;
+		sqlite3_status64(SQLITE_STATUS_MEMORY_USED, &memory.used, &memory.peak, 0);
+		return memory;
+	}
+};
+
+// Heap bytes a string owns beyond its own object: nothing while the text
+// fits in the small-string buffer
+size_t stringHeapBytes(const string& s) {
+	static const size_t inlineCapacity = string().capacity();
+	return s.capacity() > inlineCapacity ? s.capacity() + 1 : 0;
+}
+
+// Lines of "what, how many bytes" for --memory-report; `items` turns a
+// structure's bytes into bytes per item
+class MemoryReport {
+public:
+	void add(const char *what, size_t bytes, size_t items = 0) {
+		lines.push_back({what, bytes, items});
+	}
+
+	void print(ostream& out) const {
+		out << "Memory" << setw(34) << "MB" << setw(16) << "bytes / item" << endl;
+		for (const Line& line : lines) {
+			out << "  " << left << setw(28) << line.what << right << fixed << setprecision(2)
+				<< setw(10) << line.bytes / 1048576.0;
+			if (line.items) {
+				out << setprecision(1) << setw(16) << (double) line.bytes / line.items;
+			}
+			out << endl;
+		}
+	}
+
+private:
+	struct Line {
+		string what;
+		size_t bytes, items;
+	};
+
+	vector<Line> lines;
+};
+
+#endif // MEMORY_STATS_HPP
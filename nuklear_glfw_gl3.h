@@ -24,6 +24,109 @@ enum nk_glfw_init_state{
 #define NK_GLFW_TEXT_MAX 256
 #endif
 
+/* frames of vertex/element data in flight in the streaming ring */
+#ifndef NK_GLFW_RING_FRAMES
+#define NK_GLFW_RING_FRAMES 3
+#endif
+
+/* how geometry reaches the GPU */
+enum nk_glfw_upload {
+    NK_GLFW_UPLOAD_AUTO=0,      /* persistent if the driver has it, else map range */
+    NK_GLFW_UPLOAD_PERSISTENT,  /* ring in glBufferStorage memory, mapped once */
+    NK_GLFW_UPLOAD_MAP_RANGE,   /* ring mapped each frame with glMapBufferRange, unsynchronized */
+    NK_GLFW_UPLOAD_ORPHAN       /* glBufferData + glMapBuffer every frame */
+};
+
+/* parts of a frame reported to the profile hook */
+enum nk_glfw_phase {
+    NK_GLFW_PHASE_CONVERT=0,    /* nk_convert and batching the draw commands */
+    NK_GLFW_PHASE_UPLOAD,       /* getting geometry into GL buffers, fence waits included */
+    NK_GLFW_PHASE_DRAW          /* issuing the draw calls */
+};
+
+/* one frame of input, gathered by nk_glfw3_new_frame before Nuklear sees it */
+enum nk_glfw_held_keys {
+    NK_GLFW_HELD_HOME=1,
+    NK_GLFW_HELD_END=2,
+    NK_GLFW_HELD_SHIFT=4,
+    NK_GLFW_HELD_CONTROL=8
+};
+
+struct nk_glfw_input {
+    float delta_time;           /* seconds since the last frame */
+    int x, y;                   /* cursor */
+    int buttons;                /* held mouse buttons, 1 << NK_BUTTON_LEFT, MIDDLE, RIGHT */
+    int double_click;           /* left button held as the second click of a double click */
+    struct nk_vec2 double_click_pos;
+    struct nk_vec2 scroll;
+    int held;                   /* polled keys, nk_glfw_held_keys bits */
+    nk_char key_events[NK_KEY_MAX]; /* from the key callback: -1 none, else up (0) or down (1) */
+    unsigned int text[NK_GLFW_TEXT_MAX];
+    int text_len;
+};
+
+struct nk_glfw_stats {
+    double render_ms;           /* CPU time of the last nk_glfw3_render / nk_glfw3_submit */
+    double render_ms_total;     /* summed over all frames */
+    double upload_ms_total;     /* the part spent mapping, filling and unmapping buffers */
+    unsigned long frames;
+    unsigned long fence_waits;  /* frames that waited for the GPU to free a ring slot */
+    unsigned long skipped_frames; /* frames nk_glfw3_skip_frame found identical to the last one */
+    nk_size vertex_peak;        /* most vertex / element bytes a frame has needed so far */
+    nk_size element_peak;
+    int vertices;               /* vertices / elements the last frame drew from */
+    int elements;
+    unsigned long buffer_grows; /* conversions redone after the ring slots grew */
+    int draw_commands;          /* Nuklear draw commands in the last frame */
+    int draw_calls;             /* glDrawElements calls they were batched into */
+    unsigned long draw_calls_total;
+    int windows_converted;      /* retained mode: windows converted in the last frame */
+    int windows_reused;         /* and windows drawn from their cached geometry */
+};
+
+/* bytes the backend and its Nuklear context hold, from nk_glfw3_memory;
+ * frames converted for nk_glfw3_submit belong to the caller */
+struct nk_glfw_memory {
+    nk_size context;            /* Nuklear's command buffer and window pool */
+    nk_size converted;          /* CPU side of conversion: command list, batches, retained geometry */
+    nk_size gl_buffers;         /* vertex and element storage in GL: the streaming ring and retained buffers */
+};
+
+/* windows nk_glfw3_render keeps converted geometry for in retained mode */
+#ifndef NK_GLFW_RETAINED_WINDOWS
+#define NK_GLFW_RETAINED_WINDOWS 16
+#endif
+
+/* GL state as the backend last set it, so unchanged state is not set again */
+struct nk_glfw_gl_state {
+    GLuint program, vao, texture;
+    GLint scissor[4];
+};
+
+/* one draw call: a run of Nuklear draw commands with the same texture and
+ * scissor box, `elem_count` elements from `elem_offset` on */
+struct nk_glfw_draw_cmd {
+    unsigned int elem_offset, elem_count;
+    GLint scissor[4];
+    nk_handle texture;
+};
+
+/* retained mode: one window's geometry, kept in the retained buffers for as
+ * long as the window's commands hash the same */
+struct nk_glfw_window_cache {
+    nk_hash name;
+    unsigned long long hash;    /* 0 when the geometry has to be rebuilt */
+    unsigned long used;         /* frame it was last drawn in */
+    GLsizeiptr vertex_offset, vertex_capacity;
+    GLsizeiptr element_offset, element_capacity;
+    /* where this frame's conversion sits in the staging buffers, if any */
+    nk_size staged_vertex, staged_element;
+    GLsizeiptr vertex_bytes, element_bytes;
+    struct nk_glfw_draw_cmd *batches;
+    int batch_count, batch_capacity;
+    int command_count;
+};
+
 struct nk_glfw_device {
     struct nk_buffer cmds;
     struct nk_draw_null_texture tex_null;
@@ -37,6 +140,35 @@ struct nk_glfw_device {
     GLint uniform_tex;
     GLint uniform_proj;
     GLuint font_tex;
+    /* streaming ring: NK_GLFW_RING_FRAMES slots in vbo/ebo, fenced per frame */
+    enum nk_glfw_upload upload;
+    GLsizeiptr slot_vertex_size, slot_element_size;
+    void *vertex_map, *element_map;
+    GLsync fences[NK_GLFW_RING_FRAMES];
+    int slot;
+    struct nk_glfw_gl_state state;
+    /* nk_glfw3_render's draw batches, kept to avoid reallocating */
+    struct nk_glfw_draw_cmd *batches;
+    int batch_capacity;
+    /* retained mode: window geometry packed into static buffers, and the
+     * windows converted this frame, staged back to back on the CPU */
+    GLuint retained_vao, retained_vbo, retained_ebo;
+    GLsizeiptr retained_vertex_size, retained_element_size;
+    GLsizeiptr retained_vertex_used, retained_element_used;
+    struct nk_buffer retained_vbuf, retained_ebuf;
+    struct nk_glfw_window_cache windows[NK_GLFW_RETAINED_WINDOWS];
+    unsigned long retained_frame;
+};
+
+/* one converted frame, ready to be submitted to GL (possibly on another thread) */
+struct nk_glfw_frame {
+    struct nk_buffer vbuf, ebuf;
+    struct nk_glfw_draw_cmd *cmds;
+    int cmd_count, cmd_capacity;
+    int command_count;  /* Nuklear draw commands batched into cmds */
+    int width, height;
+    int display_width, display_height;
+    struct nk_vec2 fb_scale;
 };
 
 struct nk_glfw {
@@ -55,6 +187,27 @@ struct nk_glfw {
     int is_double_click_down;
     struct nk_vec2 double_click_pos;
     float delta_time_seconds_last;
+    /* called once the frame's commands are consumed, at the end of
+     * nk_glfw3_render / nk_glfw3_convert (e.g. to recycle per-frame memory) */
+    void (*frame_end)(void *user);
+    void *frame_end_user;
+    /* optional, called as each phase starts (begin=1) and ends (begin=0);
+     * phases can nest, an upload inside a convert for example */
+    void (*profile)(void *user, enum nk_glfw_phase phase, int begin);
+    void *profile_user;
+    /* optional, called with every frame's input before it goes to Nuklear:
+     * to record it, or to replace it with recorded input */
+    void (*input)(void *user, struct nk_glfw_input *in);
+    void *input_user;
+    /* set before nk_glfw3_init; the device falls back if it is unsupported */
+    enum nk_glfw_upload upload;
+    /* nk_glfw3_render caches each window's geometry and converts only the
+     * windows whose commands changed (not used by nk_glfw3_convert) */
+    int retained;
+    struct nk_glfw_stats stats;
+    /* hash of the last frame nk_glfw3_skip_frame let through; 0 before the
+     * first and after the window was damaged, which forces the next one */
+    unsigned long long frame_hash;
 };
 
 NK_API struct nk_context*   nk_glfw3_init(struct nk_glfw* glfw, GLFWwindow *win, enum nk_glfw_init_state);
@@ -62,7 +215,19 @@ NK_API void                 nk_glfw3_shutdown(struct nk_glfw* glfw);
 NK_API void                 nk_glfw3_font_stash_begin(struct nk_glfw* glfw, struct nk_font_atlas **atlas);
 NK_API void                 nk_glfw3_font_stash_end(struct nk_glfw* glfw);
 NK_API void                 nk_glfw3_new_frame(struct nk_glfw* glfw);
+/* the buffer sizes are only a starting point (0 for the minimum): the
+ * buffers grow to whatever the largest frame needs */
 NK_API void                 nk_glfw3_render(struct nk_glfw* glfw, enum nk_anti_aliasing, int max_vertex_buffer, int max_element_buffer);
+/* nk_true when the frame's commands match the last frame drawn: they are
+ * dropped and the caller skips clear, render (or convert) and swap */
+NK_API int                  nk_glfw3_skip_frame(struct nk_glfw* glfw, enum nk_anti_aliasing);
+NK_API void                 nk_glfw3_memory(const struct nk_glfw* glfw, struct nk_glfw_memory *memory);
+
+/* split rendering: convert on the UI thread, submit on the thread owning the GL context */
+NK_API void                 nk_glfw3_frame_init(struct nk_glfw_frame *frame);
+NK_API void                 nk_glfw3_frame_free(struct nk_glfw_frame *frame);
+NK_API void                 nk_glfw3_convert(struct nk_glfw* glfw, struct nk_glfw_frame *frame, enum nk_anti_aliasing);
+NK_API void                 nk_glfw3_submit(struct nk_glfw* glfw, const struct nk_glfw_frame *frame);
 
 NK_API void                 nk_glfw3_device_destroy(struct nk_glfw* glfw);
 NK_API void                 nk_glfw3_device_create(struct nk_glfw* glfw);
@@ -71,6 +236,9 @@ NK_API void                 nk_glfw3_char_callback(GLFWwindow *win, unsigned int
 NK_API void                 nk_glfw3_key_callback(GLFWwindow *win, int key, int scancode, int action, int mods);
 NK_API void                 nk_gflw3_scroll_callback(GLFWwindow *win, double xoff, double yoff);
 NK_API void                 nk_glfw3_mouse_button_callback(GLFWwindow *win, int button, int action, int mods);
+NK_API void                 nk_glfw3_refresh_callback(GLFWwindow *win);
+NK_API void                 nk_glfw3_iconify_callback(GLFWwindow *win, int iconified);
+NK_API void                 nk_glfw3_focus_callback(GLFWwindow *win, int focused);
 
 #endif
 /*
@@ -98,12 +266,62 @@ struct nk_glfw_vertex {
     nk_byte col[4];
 };
 
+/* nk_draw_index is 32 bits with NK_UINT_DRAW_INDEX, 16 otherwise */
+#define NK_GLFW_INDEX_TYPE (sizeof(nk_draw_index) == 4 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT)
+
 #ifdef __APPLE__
   #define NK_SHADER_VERSION "#version 150\n"
 #else
   #define NK_SHADER_VERSION "#version 300 es\n"
 #endif
 
+/* Creates a vertex and an element buffer and attaches them to `vao` */
+NK_INTERN void
+nk_glfw3_create_vertex_array(const struct nk_glfw_device *dev, GLuint vao, GLuint *vbo, GLuint *ebo)
+{
+    GLsizei vs = sizeof(struct nk_glfw_vertex);
+    size_t vp = offsetof(struct nk_glfw_vertex, position);
+    size_t vt = offsetof(struct nk_glfw_vertex, uv);
+    size_t vc = offsetof(struct nk_glfw_vertex, col);
+
+    glGenBuffers(1, vbo);
+    glGenBuffers(1, ebo);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, *vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *ebo);
+
+    glEnableVertexAttribArray((GLuint)dev->attrib_pos);
+    glEnableVertexAttribArray((GLuint)dev->attrib_uv);
+    glEnableVertexAttribArray((GLuint)dev->attrib_col);
+
+    glVertexAttribPointer((GLuint)dev->attrib_pos, 2, GL_FLOAT, GL_FALSE, vs, (void*)vp);
+    glVertexAttribPointer((GLuint)dev->attrib_uv, 2, GL_FLOAT, GL_FALSE, vs, (void*)vt);
+    glVertexAttribPointer((GLuint)dev->attrib_col, 4, GL_UNSIGNED_BYTE, GL_TRUE, vs, (void*)vc);
+}
+
+NK_INTERN void
+nk_glfw3_create_buffers(struct nk_glfw_device *dev)
+{
+    nk_glfw3_create_vertex_array(dev, dev->vao, &dev->vbo, &dev->ebo);
+}
+
+NK_INTERN void
+nk_glfw3_wait_fence(struct nk_glfw_device *dev, int slot, struct nk_glfw_stats *stats)
+{
+    GLenum result;
+    if (!dev->fences[slot]) return;
+    result = glClientWaitSync(dev->fences[slot], 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        if (stats) stats->fence_waits++;
+        do {
+            result = glClientWaitSync(dev->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(dev->fences[slot]);
+    dev->fences[slot] = 0;
+}
+
 NK_API void
 nk_glfw3_device_create(struct nk_glfw* glfw)
 {
@@ -157,34 +375,34 @@ nk_glfw3_device_create(struct nk_glfw* glfw)
     dev->attrib_uv = glGetAttribLocation(dev->prog, "TexCoord");
     dev->attrib_col = glGetAttribLocation(dev->prog, "Color");
 
+    /* buffer setup */
+    glGenVertexArrays(1, &dev->vao);
+    nk_glfw3_create_buffers(dev);
+    glGenVertexArrays(1, &dev->retained_vao);
+    nk_glfw3_create_vertex_array(dev, dev->retained_vao, &dev->retained_vbo, &dev->retained_ebo);
+    nk_buffer_init_default(&dev->retained_vbuf);
+    nk_buffer_init_default(&dev->retained_ebuf);
+
+    /* persistent mapping needs GL 4.4 or ARB_buffer_storage */
     {
-        /* buffer setup */
-        GLsizei vs = sizeof(struct nk_glfw_vertex);
-        size_t vp = offsetof(struct nk_glfw_vertex, position);
-        size_t vt = offsetof(struct nk_glfw_vertex, uv);
-        size_t vc = offsetof(struct nk_glfw_vertex, col);
-
-        glGenBuffers(1, &dev->vbo);
-        glGenBuffers(1, &dev->ebo);
-        glGenVertexArrays(1, &dev->vao);
-
-        glBindVertexArray(dev->vao);
-        glBindBuffer(GL_ARRAY_BUFFER, dev->vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dev->ebo);
-
-        glEnableVertexAttribArray((GLuint)dev->attrib_pos);
-        glEnableVertexAttribArray((GLuint)dev->attrib_uv);
-        glEnableVertexAttribArray((GLuint)dev->attrib_col);
-
-        glVertexAttribPointer((GLuint)dev->attrib_pos, 2, GL_FLOAT, GL_FALSE, vs, (void*)vp);
-        glVertexAttribPointer((GLuint)dev->attrib_uv, 2, GL_FLOAT, GL_FALSE, vs, (void*)vt);
-        glVertexAttribPointer((GLuint)dev->attrib_col, 4, GL_UNSIGNED_BYTE, GL_TRUE, vs, (void*)vc);
+        GLint major = 0, minor = 0;
+        int has_storage;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        has_storage = major > 4 || (major == 4 && minor >= 4) ||
+            glfwExtensionSupported("GL_ARB_buffer_storage");
+        dev->upload = glfw->upload;
+        if (dev->upload == NK_GLFW_UPLOAD_AUTO)
+            dev->upload = NK_GLFW_UPLOAD_PERSISTENT;
+        if (dev->upload == NK_GLFW_UPLOAD_PERSISTENT && !has_storage)
+            dev->upload = NK_GLFW_UPLOAD_MAP_RANGE;
     }
 
+    /* as in nk_glfw3_end_draw, the vertex array goes first */
+    glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 }
 
 NK_INTERN void
@@ -203,30 +421,109 @@ NK_API void
 nk_glfw3_device_destroy(struct nk_glfw* glfw)
 {
     struct nk_glfw_device *dev = &glfw->ogl;
+    int i;
     glDetachShader(dev->prog, dev->vert_shdr);
     glDetachShader(dev->prog, dev->frag_shdr);
     glDeleteShader(dev->vert_shdr);
     glDeleteShader(dev->frag_shdr);
     glDeleteProgram(dev->prog);
     glDeleteTextures(1, &dev->font_tex);
+    for (i = 0; i < NK_GLFW_RING_FRAMES; ++i)
+        if (dev->fences[i]) glDeleteSync(dev->fences[i]);
     glDeleteBuffers(1, &dev->vbo);
     glDeleteBuffers(1, &dev->ebo);
+    glDeleteVertexArrays(1, &dev->vao);
     nk_buffer_free(&dev->cmds);
+    free(dev->batches);
+    dev->batches = NULL;
+    dev->batch_capacity = 0;
+
+    glDeleteBuffers(1, &dev->retained_vbo);
+    glDeleteBuffers(1, &dev->retained_ebo);
+    glDeleteVertexArrays(1, &dev->retained_vao);
+    nk_buffer_free(&dev->retained_vbuf);
+    nk_buffer_free(&dev->retained_ebuf);
+    for (i = 0; i < NK_GLFW_RETAINED_WINDOWS; ++i)
+        free(dev->windows[i].batches);
+    memset(dev->windows, 0, sizeof(dev->windows));
+    dev->retained_vertex_size = dev->retained_element_size = 0;
+    dev->retained_vertex_used = dev->retained_element_used = 0;
 }
 
-NK_API void
-nk_glfw3_render(struct nk_glfw* glfw, enum nk_anti_aliasing AA, int max_vertex_buffer, int max_element_buffer)
+NK_INTERN void
+nk_glfw3_convert_config(const struct nk_glfw_device *dev, enum nk_anti_aliasing AA,
+    struct nk_convert_config *config)
+{
+    static const struct nk_draw_vertex_layout_element vertex_layout[] = {
+        {NK_VERTEX_POSITION, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_glfw_vertex, position)},
+        {NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_glfw_vertex, uv)},
+        {NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, NK_OFFSETOF(struct nk_glfw_vertex, col)},
+        {NK_VERTEX_LAYOUT_END}
+    };
+    memset(config, 0, sizeof(*config));
+    config->vertex_layout = vertex_layout;
+    config->vertex_size = sizeof(struct nk_glfw_vertex);
+    config->vertex_alignment = NK_ALIGNOF(struct nk_glfw_vertex);
+    config->tex_null = dev->tex_null;
+    config->circle_segment_count = 22;
+    config->curve_segment_count = 22;
+    config->arc_segment_count = 22;
+    config->global_alpha = 1.0f;
+    config->shape_AA = AA;
+    config->line_AA = AA;
+}
+
+NK_INTERN void
+nk_glfw3_use_program(struct nk_glfw_device *dev, GLuint program)
+{
+    if (dev->state.program == program) return;
+    glUseProgram(program);
+    dev->state.program = program;
+}
+
+NK_INTERN void
+nk_glfw3_bind_vertex_array(struct nk_glfw_device *dev, GLuint vao)
+{
+    if (dev->state.vao == vao) return;
+    glBindVertexArray(vao);
+    dev->state.vao = vao;
+}
+
+NK_INTERN void
+nk_glfw3_bind_texture(struct nk_glfw_device *dev, GLuint texture)
+{
+    if (dev->state.texture == texture) return;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    dev->state.texture = texture;
+}
+
+NK_INTERN void
+nk_glfw3_scissor(struct nk_glfw_device *dev, const GLint *box)
+{
+    if (!memcmp(dev->state.scissor, box, sizeof(dev->state.scissor))) return;
+    glScissor(box[0], box[1], box[2], box[3]);
+    memcpy(dev->state.scissor, box, sizeof(dev->state.scissor));
+}
+
+/* Anything may have touched GL since the last frame */
+NK_INTERN void
+nk_glfw3_forget_state(struct nk_glfw_device *dev)
+{
+    memset(&dev->state, 0xff, sizeof(dev->state));
+}
+
+NK_INTERN void
+nk_glfw3_begin_draw(struct nk_glfw_device *dev, int width, int height,
+    int display_width, int display_height)
 {
-    struct nk_glfw_device *dev = &glfw->ogl;
-    struct nk_buffer vbuf, ebuf;
     GLfloat ortho[4][4] = {
         {2.0f, 0.0f, 0.0f, 0.0f},
         {0.0f,-2.0f, 0.0f, 0.0f},
         {0.0f, 0.0f,-1.0f, 0.0f},
         {-1.0f,1.0f, 0.0f, 1.0f},
     };
-    ortho[0][0] /= (GLfloat)glfw->width;
-    ortho[1][1] /= (GLfloat)glfw->height;
+    ortho[0][0] /= (GLfloat)width;
+    ortho[1][1] /= (GLfloat)height;
 
     /* setup global state */
     glEnable(GL_BLEND);
@@ -238,80 +535,753 @@ nk_glfw3_render(struct nk_glfw* glfw, enum nk_anti_aliasing AA, int max_vertex_b
     glActiveTexture(GL_TEXTURE0);
 
     /* setup program */
-    glUseProgram(dev->prog);
+    nk_glfw3_forget_state(dev);
+    nk_glfw3_use_program(dev, dev->prog);
     glUniform1i(dev->uniform_tex, 0);
     glUniformMatrix4fv(dev->uniform_proj, 1, GL_FALSE, &ortho[0][0]);
-    glViewport(0,0,(GLsizei)glfw->display_width,(GLsizei)glfw->display_height);
+    glViewport(0,0,(GLsizei)display_width,(GLsizei)display_height);
+
+    nk_glfw3_bind_vertex_array(dev, dev->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, dev->vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dev->ebo);
+}
+
+NK_INTERN void
+nk_glfw3_end_draw(void)
+{
+    /* default OpenGL state; the element buffer binding belongs to the
+     * vertex array, so that is unbound first */
+    glUseProgram(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+/* Makes room for one frame of `vertex_size` + `element_size` bytes per
+ * ring slot. The ring paths need immutable or fixed-size storage, so growing
+ * means waiting for the GPU and starting over with new buffers. */
+NK_INTERN void
+nk_glfw3_ring_reserve(struct nk_glfw_device *dev, GLsizeiptr vertex_size, GLsizeiptr element_size)
+{
+    const GLbitfield storage = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr vs = (GLsizeiptr)sizeof(struct nk_glfw_vertex);
+    int i;
+
+    if (dev->slot_vertex_size && vertex_size <= dev->slot_vertex_size &&
+        element_size <= dev->slot_element_size)
+        return;
+    /* grow geometrically, and only the buffer that is short */
+    if (!dev->slot_vertex_size || vertex_size > dev->slot_vertex_size)
+        vertex_size = NK_MAX(NK_MAX(vertex_size, dev->slot_vertex_size * 2), 64 * 1024);
+    else vertex_size = dev->slot_vertex_size;
+    if (!dev->slot_element_size || element_size > dev->slot_element_size)
+        element_size = NK_MAX(NK_MAX(element_size, dev->slot_element_size * 2), 16 * 1024);
+    else element_size = dev->slot_element_size;
+    /* whole vertices per slot, so a slot starts at a base vertex */
+    vertex_size = (vertex_size + vs - 1) / vs * vs;
+    element_size = (element_size + 3) & ~(GLsizeiptr)3;
+    dev->slot_vertex_size = vertex_size;
+    dev->slot_element_size = element_size;
+    if (dev->upload == NK_GLFW_UPLOAD_ORPHAN)
+        return;
+
+    for (i = 0; i < NK_GLFW_RING_FRAMES; ++i)
+        nk_glfw3_wait_fence(dev, i, NULL);
+    glDeleteBuffers(1, &dev->vbo);
+    glDeleteBuffers(1, &dev->ebo);
+    nk_glfw3_create_buffers(dev);
+    dev->slot = 0;
+
+    if (dev->upload == NK_GLFW_UPLOAD_PERSISTENT) {
+        glBufferStorage(GL_ARRAY_BUFFER, vertex_size * NK_GLFW_RING_FRAMES, NULL, storage);
+        glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, element_size * NK_GLFW_RING_FRAMES, NULL, storage);
+        dev->vertex_map = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertex_size * NK_GLFW_RING_FRAMES, storage);
+        dev->element_map = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, element_size * NK_GLFW_RING_FRAMES, storage);
+        if (dev->vertex_map && dev->element_map)
+            return;
+        /* the storage is immutable: start over with mutable buffers */
+        dev->upload = NK_GLFW_UPLOAD_MAP_RANGE;
+        glDeleteBuffers(1, &dev->vbo);
+        glDeleteBuffers(1, &dev->ebo);
+        nk_glfw3_create_buffers(dev);
+    }
+    glBufferData(GL_ARRAY_BUFFER, vertex_size * NK_GLFW_RING_FRAMES, NULL, GL_STREAM_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, element_size * NK_GLFW_RING_FRAMES, NULL, GL_STREAM_DRAW);
+}
+
+/* Maps the current slot for writing; the vbo and ebo must be bound */
+NK_INTERN void
+nk_glfw3_ring_map(struct nk_glfw_device *dev, struct nk_glfw_stats *stats,
+    void **vertices, void **elements)
+{
+    const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    GLintptr vertex_offset = dev->slot * dev->slot_vertex_size;
+    GLintptr element_offset = dev->slot * dev->slot_element_size;
+
+    switch (dev->upload) {
+    case NK_GLFW_UPLOAD_PERSISTENT:
+        nk_glfw3_wait_fence(dev, dev->slot, stats);
+        *vertices = (char*)dev->vertex_map + vertex_offset;
+        *elements = (char*)dev->element_map + element_offset;
+        break;
+    case NK_GLFW_UPLOAD_MAP_RANGE:
+        nk_glfw3_wait_fence(dev, dev->slot, stats);
+        *vertices = glMapBufferRange(GL_ARRAY_BUFFER, vertex_offset, dev->slot_vertex_size, access);
+        *elements = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, element_offset, dev->slot_element_size, access);
+        break;
+    default:
+        glBufferData(GL_ARRAY_BUFFER, dev->slot_vertex_size, NULL, GL_STREAM_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, dev->slot_element_size, NULL, GL_STREAM_DRAW);
+        *vertices = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+        *elements = glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY);
+        break;
+    }
+}
+
+NK_INTERN void
+nk_glfw3_ring_unmap(const struct nk_glfw_device *dev)
+{
+    if (dev->upload == NK_GLFW_UPLOAD_PERSISTENT) return;
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+}
+
+/* First vertex and element byte offset of the current slot */
+NK_INTERN GLint
+nk_glfw3_ring_base_vertex(const struct nk_glfw_device *dev)
+{
+    if (dev->upload == NK_GLFW_UPLOAD_ORPHAN) return 0;
+    return (GLint)(dev->slot * dev->slot_vertex_size / (GLsizeiptr)sizeof(struct nk_glfw_vertex));
+}
+
+NK_INTERN nk_size
+nk_glfw3_ring_element_offset(const struct nk_glfw_device *dev)
+{
+    if (dev->upload == NK_GLFW_UPLOAD_ORPHAN) return 0;
+    return (nk_size)(dev->slot * dev->slot_element_size);
+}
+
+/* Fences the slot the frame was drawn from and moves on to the next one */
+NK_INTERN void
+nk_glfw3_ring_advance(struct nk_glfw_device *dev)
+{
+    if (dev->upload == NK_GLFW_UPLOAD_ORPHAN) return;
+    dev->fences[dev->slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    dev->slot = (dev->slot + 1) % NK_GLFW_RING_FRAMES;
+}
+
+NK_INTERN void
+nk_glfw3_count_geometry(struct nk_glfw_stats *stats, nk_size vertex_bytes, nk_size element_bytes)
+{
+    stats->vertices = (int)(vertex_bytes / sizeof(struct nk_glfw_vertex));
+    stats->elements = (int)(element_bytes / sizeof(nk_draw_index));
+    stats->vertex_peak = NK_MAX(stats->vertex_peak, vertex_bytes);
+    stats->element_peak = NK_MAX(stats->element_peak, element_bytes);
+}
+
+NK_INTERN void
+nk_glfw3_phase(struct nk_glfw *glfw, enum nk_glfw_phase phase, int begin)
+{
+    if (glfw->profile)
+        glfw->profile(glfw->profile_user, phase, begin);
+}
+
+NK_INTERN void
+nk_glfw3_count_render(struct nk_glfw_stats *stats, double start)
+{
+    stats->render_ms = (glfwGetTime() - start) * 1000.0;
+    stats->render_ms_total += stats->render_ms;
+    stats->frames++;
+}
+
+/* Scissor box of a clip rect, clamped to the framebuffer so that every clip
+ * covering all of it (like nk_null_rect) gives the same box */
+NK_INTERN void
+nk_glfw3_scissor_box(struct nk_rect clip, int height, int display_width, int display_height,
+    struct nk_vec2 fb_scale, GLint *box)
+{
+    GLint x = (GLint)(clip.x * fb_scale.x);
+    GLint y = (GLint)((height - (GLint)(clip.y + clip.h)) * fb_scale.y);
+    GLint right = x + (GLint)(clip.w * fb_scale.x);
+    GLint top = y + (GLint)(clip.h * fb_scale.y);
+    x = NK_CLAMP(0, x, display_width);
+    y = NK_CLAMP(0, y, display_height);
+    right = NK_CLAMP(x, right, display_width);
+    top = NK_CLAMP(y, top, display_height);
+    box[0] = x;
+    box[1] = y;
+    box[2] = right - x;
+    box[3] = top - y;
+}
+
+/* Turns the converted draw commands into draw calls. Commands are laid out
+ * back to back in the element buffer, so a command with the same texture and
+ * scissor box as the previous call extends it; commands clipped away entirely
+ * are dropped. Returns the number of calls; out of memory, the rest are lost. */
+NK_INTERN int
+nk_glfw3_batch(struct nk_context *ctx, const struct nk_buffer *cmds,
+    int height, int display_width, int display_height, struct nk_vec2 fb_scale,
+    struct nk_glfw_draw_cmd **batches, int *capacity, int *commands)
+{
+    const struct nk_draw_command *cmd;
+    struct nk_glfw_draw_cmd *last = NULL;
+    unsigned int offset = 0;
+    int count = 0;
+    GLint box[4];
+
+    *commands = 0;
+    nk_draw_foreach(cmd, ctx, cmds)
     {
-        /* convert from command queue into draw list and draw to screen */
-        const struct nk_draw_command *cmd;
-        void *vertices, *elements;
-        nk_size offset = 0;
+        if (!cmd->elem_count) continue;
+        (*commands)++;
+        nk_glfw3_scissor_box(cmd->clip_rect, height, display_width, display_height, fb_scale, box);
+        if (!box[2] || !box[3]) {
+            offset += cmd->elem_count;
+            continue;
+        }
+        if (last && last->texture.id == cmd->texture.id &&
+            last->elem_offset + last->elem_count == offset &&
+            !memcmp(last->scissor, box, sizeof(box))) {
+            last->elem_count += cmd->elem_count;
+            offset += cmd->elem_count;
+            continue;
+        }
+        if (count == *capacity) {
+            int grown = *capacity ? *capacity * 2 : 64;
+            void *memory = realloc(*batches, (size_t)grown * sizeof(**batches));
+            if (!memory) break;
+            *batches = (struct nk_glfw_draw_cmd*)memory;
+            *capacity = grown;
+        }
+        last = &(*batches)[count++];
+        last->elem_offset = offset;
+        last->elem_count = cmd->elem_count;
+        memcpy(last->scissor, box, sizeof(box));
+        last->texture = cmd->texture;
+        offset += cmd->elem_count;
+    }
+    return count;
+}
+
+/* Draws batches whose elements start at byte `offset` of the element buffer
+ * and whose vertices start at `base_vertex` */
+NK_INTERN void
+nk_glfw3_draw_batches(struct nk_glfw_device *dev, const struct nk_glfw_draw_cmd *batches,
+    int count, nk_size offset, GLint base_vertex)
+{
+    int i;
+    for (i = 0; i < count; ++i) {
+        const struct nk_glfw_draw_cmd *batch = &batches[i];
+        nk_glfw3_bind_texture(dev, (GLuint)batch->texture.id);
+        nk_glfw3_scissor(dev, batch->scissor);
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)batch->elem_count, NK_GLFW_INDEX_TYPE,
+            (const void*)(offset + batch->elem_offset * sizeof(nk_draw_index)), base_vertex);
+    }
+}
+
+NK_INTERN void
+nk_glfw3_count_draws(struct nk_glfw_stats *stats, int commands, int calls)
+{
+    stats->draw_commands = commands;
+    stats->draw_calls = calls;
+    stats->draw_calls_total += (unsigned long)calls;
+}
+
+/* FNV-1a over 64-bit words, the tail byte by byte */
+NK_INTERN unsigned long long
+nk_glfw3_hash(unsigned long long hash, const void *data, nk_size size)
+{
+    const unsigned long long prime = 0x100000001b3ULL;
+    const nk_byte *bytes = (const nk_byte*)data;
+    unsigned long long word;
+    nk_size i = 0;
+    for (; i + sizeof(word) <= size; i += sizeof(word)) {
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ bytes[i]) * prime;
+    return hash;
+}
+
+/* Hash of one window's commands. The `next` links are left out: they are
+ * offsets into the context's command memory and move whenever a window drawn
+ * before this one changes size. */
+NK_INTERN unsigned long long
+nk_glfw3_hash_window(const struct nk_context *ctx, const struct nk_window *win,
+    unsigned long long hash)
+{
+    const nk_byte *memory = (const nk_byte*)nk_buffer_memory_const(&ctx->memory);
+    nk_size offset = win->buffer.begin;
+    while (1) {
+        const struct nk_command *cmd = (const struct nk_command*)(memory + offset);
+        nk_size end = offset == win->buffer.last ? win->buffer.end : cmd->next;
+        hash = nk_glfw3_hash(hash, &cmd->type, sizeof(cmd->type));
+        hash = nk_glfw3_hash(hash, cmd + 1, end - offset - sizeof(*cmd));
+        if (offset == win->buffer.last) break;
+        offset = cmd->next;
+    }
+    return hash;
+}
+
+/* nk_convert for a single window: nk_foreach starts at ctx->begin and ends
+ * where a command links past the end of the command memory, so both are
+ * pointed at this window for the duration */
+NK_INTERN nk_flags
+nk_glfw3_convert_window(struct nk_context *ctx, struct nk_window *win, struct nk_buffer *cmds,
+    struct nk_buffer *vertices, struct nk_buffer *elements, const struct nk_convert_config *config)
+{
+    struct nk_command *last = (struct nk_command*)
+        ((nk_byte*)nk_buffer_memory(&ctx->memory) + win->buffer.last);
+    struct nk_window *begin = ctx->begin;
+    nk_size next = last->next;
+    nk_flags result;
+
+    ctx->begin = win;
+    last->next = ctx->memory.allocated;
+    result = nk_convert(ctx, cmds, vertices, elements, config);
+    last->next = next;
+    ctx->begin = begin;
+    return result;
+}
+
+NK_INTERN struct nk_glfw_window_cache*
+nk_glfw3_window_cache(struct nk_glfw_device *dev, nk_hash name)
+{
+    struct nk_glfw_window_cache *oldest = &dev->windows[0];
+    int i;
+    for (i = 0; i < NK_GLFW_RETAINED_WINDOWS; ++i) {
+        struct nk_glfw_window_cache *entry = &dev->windows[i];
+        if (entry->name == name && entry->used)
+            return entry;
+        if (entry->used < oldest->used)
+            oldest = entry;
+    }
+    /* reuse the least recently drawn entry; its buffer space is lost until
+     * the buffers are next packed */
+    oldest->name = name;
+    oldest->hash = 0;
+    oldest->vertex_capacity = oldest->element_capacity = 0;
+    return oldest;
+}
+
+/* Starts the retained buffers over at (at least) the given sizes; every
+ * window is converted again */
+NK_INTERN void
+nk_glfw3_retained_reset(struct nk_glfw_device *dev, GLsizeiptr vertex_size, GLsizeiptr element_size)
+{
+    int i;
+    dev->retained_vertex_size = NK_MAX(vertex_size, dev->retained_vertex_size);
+    dev->retained_element_size = NK_MAX(element_size, dev->retained_element_size);
+    dev->retained_vertex_used = dev->retained_element_used = 0;
+    glBufferData(GL_ARRAY_BUFFER, dev->retained_vertex_size, NULL, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, dev->retained_element_size, NULL, GL_DYNAMIC_DRAW);
+    for (i = 0; i < NK_GLFW_RETAINED_WINDOWS; ++i) {
+        dev->windows[i].hash = 0;
+        dev->windows[i].vertex_capacity = dev->windows[i].element_capacity = 0;
+    }
+}
+
+/* Converts `win` into its cache entry, appending the geometry to the staging
+ * buffers, and finds it space in the retained buffers. Returns nk_false if
+ * they are out of space. */
+NK_INTERN int
+nk_glfw3_retain_window(struct nk_glfw *glfw, struct nk_window *win,
+    struct nk_glfw_window_cache *entry, const struct nk_convert_config *config)
+{
+    struct nk_glfw_device *dev = &glfw->ogl;
+    GLsizeiptr vertex_bytes, element_bytes;
+
+    entry->staged_vertex = dev->retained_vbuf.allocated;
+    entry->staged_element = dev->retained_ebuf.allocated;
+    nk_buffer_clear(&dev->cmds);
+    nk_glfw3_convert_window(&glfw->ctx, win, &dev->cmds, &dev->retained_vbuf, &dev->retained_ebuf, config);
+    vertex_bytes = (GLsizeiptr)(dev->retained_vbuf.allocated - entry->staged_vertex);
+    element_bytes = (GLsizeiptr)(dev->retained_ebuf.allocated - entry->staged_element);
+    entry->vertex_bytes = vertex_bytes;
+    entry->element_bytes = element_bytes;
 
-        /* allocate vertex and element buffer */
-        glBindVertexArray(dev->vao);
-        glBindBuffer(GL_ARRAY_BUFFER, dev->vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dev->ebo);
+    if (vertex_bytes > entry->vertex_capacity || element_bytes > entry->element_capacity) {
+        /* move to fresh space with some room to grow */
+        GLsizeiptr vs = (GLsizeiptr)sizeof(struct nk_glfw_vertex);
+        GLsizeiptr vertex_capacity = (vertex_bytes + vertex_bytes / 2 + vs - 1) / vs * vs;
+        GLsizeiptr element_capacity = (element_bytes + element_bytes / 2 + 3) & ~(GLsizeiptr)3;
+        entry->vertex_capacity = vertex_capacity;
+        entry->element_capacity = element_capacity;
+        if (dev->retained_vertex_used + vertex_capacity > dev->retained_vertex_size ||
+            dev->retained_element_used + element_capacity > dev->retained_element_size)
+            return nk_false;
+        entry->vertex_offset = dev->retained_vertex_used;
+        entry->element_offset = dev->retained_element_used;
+        dev->retained_vertex_used += vertex_capacity;
+        dev->retained_element_used += element_capacity;
+    }
+    entry->batch_count = nk_glfw3_batch(&glfw->ctx, &dev->cmds, glfw->height,
+        glfw->display_width, glfw->display_height, glfw->fb_scale,
+        &entry->batches, &entry->batch_capacity, &entry->command_count);
+    return nk_true;
+}
+
+/* Moves the staged geometry of the windows converted this frame into their
+ * space in the retained buffers: into a slot of the streaming ring, then on
+ * by copies on the GPU. Those queue up behind the draws still reading the
+ * retained buffers instead of making the driver wait for them. */
+NK_INTERN void
+nk_glfw3_retained_upload(struct nk_glfw *glfw, struct nk_glfw_window_cache **dirty, int count)
+{
+    struct nk_glfw_device *dev = &glfw->ogl;
+    GLintptr vertex_base, element_base;
+    void *vertices, *elements;
+    int i;
+
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_UPLOAD, nk_true);
+    nk_glfw3_bind_vertex_array(dev, dev->vao);
+    nk_glfw3_ring_reserve(dev, (GLsizeiptr)dev->retained_vbuf.allocated, (GLsizeiptr)dev->retained_ebuf.allocated);
+    glBindBuffer(GL_ARRAY_BUFFER, dev->vbo);
+    nk_glfw3_ring_map(dev, &glfw->stats, &vertices, &elements);
+    memcpy(vertices, nk_buffer_memory_const(&dev->retained_vbuf), dev->retained_vbuf.allocated);
+    memcpy(elements, nk_buffer_memory_const(&dev->retained_ebuf), dev->retained_ebuf.allocated);
+    nk_glfw3_ring_unmap(dev);
+
+    vertex_base = (GLintptr)nk_glfw3_ring_base_vertex(dev) * (GLintptr)sizeof(struct nk_glfw_vertex);
+    element_base = (GLintptr)nk_glfw3_ring_element_offset(dev);
+    glBindBuffer(GL_COPY_READ_BUFFER, dev->vbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dev->retained_vbo);
+    for (i = 0; i < count; ++i)
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+            vertex_base + (GLintptr)dirty[i]->staged_vertex, dirty[i]->vertex_offset, dirty[i]->vertex_bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, dev->ebo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dev->retained_ebo);
+    for (i = 0; i < count; ++i)
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+            element_base + (GLintptr)dirty[i]->staged_element, dirty[i]->element_offset, dirty[i]->element_bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    /* the copies read the slot, so it is fenced like a drawn frame's */
+    nk_glfw3_ring_advance(dev);
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_UPLOAD, nk_false);
+}
 
-        glBufferData(GL_ARRAY_BUFFER, max_vertex_buffer, NULL, GL_STREAM_DRAW);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_element_buffer, NULL, GL_STREAM_DRAW);
+/* Retained mode of nk_glfw3_render: windows whose commands hash the same as
+ * last time are drawn from the geometry already in the retained buffers, the
+ * rest are converted and uploaded into their space there. Returns nk_false,
+ * having done nothing, for frames with more windows than cache entries and
+ * for frames with popups or a cursor overlay: nk__begin links those in after
+ * the last window, where no window's entry covers them. */
+NK_INTERN int
+nk_glfw3_render_retained(struct nk_glfw *glfw, enum nk_anti_aliasing AA)
+{
+    struct nk_glfw_device *dev = &glfw->ogl;
+    struct nk_context *ctx = &glfw->ctx;
+    struct nk_glfw_window_cache *order[NK_GLFW_RETAINED_WINDOWS];
+    struct nk_glfw_window_cache *dirty[NK_GLFW_RETAINED_WINDOWS];
+    struct nk_convert_config config;
+    struct nk_window *win;
+    const struct nk_command *last = NULL;
+    GLsizeiptr vs = (GLsizeiptr)sizeof(struct nk_glfw_vertex);
+    unsigned long long frame_hash = 0xcbf29ce484222325ULL;
+    int target[5];
+    int count = 0, converted, commands = 0, calls = 0, i;
+    double upload_start;
+
+    nk__begin(ctx);
+    for (win = ctx->begin; win; win = win->next) {
+        if (win->buffer.last == win->buffer.begin || (win->flags & NK_WINDOW_HIDDEN) ||
+            win->seq != ctx->seq)
+            continue;
+        last = (const struct nk_command*)((const nk_byte*)nk_buffer_memory_const(&ctx->memory) + win->buffer.last);
+        count++;
+    }
+    if (count > NK_GLFW_RETAINED_WINDOWS || (last && last->next != ctx->memory.allocated))
+        return nk_false;
 
-        /* load draw vertices & elements directly into vertex + element buffer */
-        vertices = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-        elements = glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY);
+    upload_start = glfwGetTime();
+    target[0] = glfw->width;
+    target[1] = glfw->height;
+    target[2] = glfw->display_width;
+    target[3] = glfw->display_height;
+    target[4] = (int)AA;
+    frame_hash = nk_glfw3_hash(frame_hash, target, sizeof(target));
+    frame_hash = nk_glfw3_hash(frame_hash, &glfw->fb_scale, sizeof(glfw->fb_scale));
+
+    nk_glfw3_convert_config(dev, AA, &config);
+    nk_glfw3_bind_vertex_array(dev, dev->retained_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, dev->retained_vbo);
+    if (!dev->retained_vertex_size)
+        nk_glfw3_retained_reset(dev, 256 * 1024, 64 * 1024);
+    dev->retained_frame++;
+
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_CONVERT, nk_true);
+    while (1) {
+        int full = nk_false;
+        count = converted = 0;
+        nk_buffer_clear(&dev->retained_vbuf);
+        nk_buffer_clear(&dev->retained_ebuf);
+        for (win = ctx->begin; win; win = win->next) {
+            struct nk_glfw_window_cache *entry;
+            unsigned long long hash;
+            if (win->buffer.last == win->buffer.begin || (win->flags & NK_WINDOW_HIDDEN) ||
+                win->seq != ctx->seq)
+                continue;
+            hash = nk_glfw3_hash_window(ctx, win, frame_hash);
+            entry = nk_glfw3_window_cache(dev, win->name);
+            entry->used = dev->retained_frame;
+            order[count++] = entry;
+            if (entry->hash == hash) continue;
+            if (!nk_glfw3_retain_window(glfw, win, entry, &config)) {
+                full = nk_true;
+                break;
+            }
+            entry->hash = hash;
+            dirty[converted++] = entry;
+        }
+        if (!full) break;
+        /* pack everything again, doubling the buffers if they are more
+         * than half full of live geometry */
         {
-            /* fill convert configuration */
-            struct nk_convert_config config;
-            static const struct nk_draw_vertex_layout_element vertex_layout[] = {
-                {NK_VERTEX_POSITION, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_glfw_vertex, position)},
-                {NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_glfw_vertex, uv)},
-                {NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, NK_OFFSETOF(struct nk_glfw_vertex, col)},
-                {NK_VERTEX_LAYOUT_END}
-            };
-            memset(&config, 0, sizeof(config));
-            config.vertex_layout = vertex_layout;
-            config.vertex_size = sizeof(struct nk_glfw_vertex);
-            config.vertex_alignment = NK_ALIGNOF(struct nk_glfw_vertex);
-            config.tex_null = dev->tex_null;
-            config.circle_segment_count = 22;
-            config.curve_segment_count = 22;
-            config.arc_segment_count = 22;
-            config.global_alpha = 1.0f;
-            config.shape_AA = AA;
-            config.line_AA = AA;
-
-            /* setup buffers to load vertices and elements */
-            nk_buffer_init_fixed(&vbuf, vertices, (size_t)max_vertex_buffer);
-            nk_buffer_init_fixed(&ebuf, elements, (size_t)max_element_buffer);
-            nk_convert(&glfw->ctx, &dev->cmds, &vbuf, &ebuf, &config);
+            GLsizeiptr vertex_live = 0, element_live = 0;
+            for (i = 0; i < count; ++i) {
+                vertex_live += order[i]->vertex_capacity;
+                element_live += order[i]->element_capacity;
+            }
+            nk_glfw3_retained_reset(dev,
+                vertex_live * 2 > dev->retained_vertex_size ? dev->retained_vertex_size * 2 : 0,
+                element_live * 2 > dev->retained_element_size ? dev->retained_element_size * 2 : 0);
+            glfw->stats.buffer_grows++;
         }
-        glUnmapBuffer(GL_ARRAY_BUFFER);
-        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+    }
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_CONVERT, nk_false);
+    if (converted) {
+        nk_glfw3_retained_upload(glfw, dirty, converted);
+        nk_glfw3_bind_vertex_array(dev, dev->retained_vao);
+    }
+    glfw->stats.upload_ms_total += (glfwGetTime() - upload_start) * 1000.0;
+    nk_glfw3_count_geometry(&glfw->stats, (nk_size)dev->retained_vertex_used, (nk_size)dev->retained_element_used);
 
-        /* iterate over and execute each draw command */
-        nk_draw_foreach(cmd, &glfw->ctx, &dev->cmds)
-        {
-            if (!cmd->elem_count) continue;
-            glBindTexture(GL_TEXTURE_2D, (GLuint)cmd->texture.id);
-            glScissor(
-                (GLint)(cmd->clip_rect.x * glfw->fb_scale.x),
-                (GLint)((glfw->height - (GLint)(cmd->clip_rect.y + cmd->clip_rect.h)) * glfw->fb_scale.y),
-                (GLint)(cmd->clip_rect.w * glfw->fb_scale.x),
-                (GLint)(cmd->clip_rect.h * glfw->fb_scale.y));
-            glDrawElements(GL_TRIANGLES, (GLsizei)cmd->elem_count, GL_UNSIGNED_SHORT, (const void*) offset);
-            offset += cmd->elem_count * sizeof(nk_draw_index);
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_DRAW, nk_true);
+    for (i = 0; i < count; ++i) {
+        nk_glfw3_draw_batches(dev, order[i]->batches, order[i]->batch_count,
+            (nk_size)order[i]->element_offset, (GLint)(order[i]->vertex_offset / vs));
+        commands += order[i]->command_count;
+        calls += order[i]->batch_count;
+    }
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_DRAW, nk_false);
+    nk_glfw3_count_draws(&glfw->stats, commands, calls);
+    glfw->stats.windows_converted = converted;
+    glfw->stats.windows_reused = count - converted;
+    return nk_true;
+}
+
+NK_API void
+nk_glfw3_render(struct nk_glfw* glfw, enum nk_anti_aliasing AA, int max_vertex_buffer, int max_element_buffer)
+{
+    struct nk_glfw_device *dev = &glfw->ogl;
+    struct nk_buffer vbuf, ebuf;
+    double start = glfwGetTime();
+
+    if (glfw->retained) {
+        nk_glfw3_begin_draw(dev, glfw->width, glfw->height, glfw->display_width, glfw->display_height);
+        if (nk_glfw3_render_retained(glfw, AA)) {
+            nk_clear(&glfw->ctx);
+            nk_buffer_clear(&dev->cmds);
+            nk_glfw3_end_draw();
+            nk_glfw3_count_render(&glfw->stats, start);
+            if (glfw->frame_end)
+                glfw->frame_end(glfw->frame_end_user);
+            return;
         }
+    }
+
+    nk_glfw3_ring_reserve(dev, max_vertex_buffer, max_element_buffer);
+    nk_glfw3_begin_draw(dev, glfw->width, glfw->height, glfw->display_width, glfw->display_height);
+    {
+        /* convert from command queue into draw list and draw to screen */
+        struct nk_convert_config config;
+        void *vertices, *elements;
+        nk_flags result;
+        int batches, commands;
+        double upload_start;
+
+        /* load draw vertices & elements directly into this frame's ring slot */
+        upload_start = glfwGetTime();
+        nk_glfw3_convert_config(dev, AA, &config);
+        while (1) {
+            nk_glfw3_phase(glfw, NK_GLFW_PHASE_UPLOAD, nk_true);
+            nk_glfw3_ring_map(dev, &glfw->stats, &vertices, &elements);
+            nk_buffer_init_fixed(&vbuf, vertices, (size_t)dev->slot_vertex_size);
+            nk_buffer_init_fixed(&ebuf, elements, (size_t)dev->slot_element_size);
+            nk_glfw3_phase(glfw, NK_GLFW_PHASE_CONVERT, nk_true);
+            result = nk_convert(&glfw->ctx, &dev->cmds, &vbuf, &ebuf, &config);
+            nk_glfw3_phase(glfw, NK_GLFW_PHASE_CONVERT, nk_false);
+            nk_glfw3_ring_unmap(dev);
+            nk_glfw3_phase(glfw, NK_GLFW_PHASE_UPLOAD, nk_false);
+            if (!(result & (NK_CONVERT_VERTEX_BUFFER_FULL|NK_CONVERT_ELEMENT_BUFFER_FULL)))
+                break;
+            /* the slot was too small and geometry got dropped: `needed` has
+             * the full size, so grow (at least doubling) and convert again */
+            nk_glfw3_ring_reserve(dev,
+                (result & NK_CONVERT_VERTEX_BUFFER_FULL) ?
+                    NK_MAX((GLsizeiptr)vbuf.needed, dev->slot_vertex_size + 1) : 0,
+                (result & NK_CONVERT_ELEMENT_BUFFER_FULL) ?
+                    NK_MAX((GLsizeiptr)ebuf.needed, dev->slot_element_size + 1) : 0);
+            nk_buffer_clear(&dev->cmds);
+            glfw->stats.buffer_grows++;
+        }
+        glfw->stats.upload_ms_total += (glfwGetTime() - upload_start) * 1000.0;
+        nk_glfw3_count_geometry(&glfw->stats, vbuf.needed, ebuf.needed);
+
+        /* batch the draw commands and execute them */
+        nk_glfw3_phase(glfw, NK_GLFW_PHASE_CONVERT, nk_true);
+        batches = nk_glfw3_batch(&glfw->ctx, &dev->cmds, glfw->height,
+            glfw->display_width, glfw->display_height, glfw->fb_scale,
+            &dev->batches, &dev->batch_capacity, &commands);
+        nk_glfw3_phase(glfw, NK_GLFW_PHASE_CONVERT, nk_false);
+        nk_glfw3_phase(glfw, NK_GLFW_PHASE_DRAW, nk_true);
+        nk_glfw3_draw_batches(dev, dev->batches, batches,
+            nk_glfw3_ring_element_offset(dev), nk_glfw3_ring_base_vertex(dev));
+        nk_glfw3_phase(glfw, NK_GLFW_PHASE_DRAW, nk_false);
+        nk_glfw3_count_draws(&glfw->stats, commands, batches);
+        nk_glfw3_ring_advance(dev);
         nk_clear(&glfw->ctx);
         nk_buffer_clear(&dev->cmds);
     }
+    nk_glfw3_end_draw();
+    nk_glfw3_count_render(&glfw->stats, start);
+    if (glfw->frame_end)
+        glfw->frame_end(glfw->frame_end_user);
+}
+
+NK_API int
+nk_glfw3_skip_frame(struct nk_glfw* glfw, enum nk_anti_aliasing AA)
+{
+    struct nk_context *ctx = &glfw->ctx;
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    int target[5];
+
+    /* nk__begin links the window buffers into the final command list, so
+     * the memory hashed is exactly what nk_convert would walk. Padding
+     * between commands can hold stale bytes; at worst that costs a redraw. */
+    nk__begin(ctx);
+    target[0] = glfw->width;
+    target[1] = glfw->height;
+    target[2] = glfw->display_width;
+    target[3] = glfw->display_height;
+    target[4] = (int)AA;
+    hash = nk_glfw3_hash(hash, target, sizeof(target));
+    hash = nk_glfw3_hash(hash, &glfw->fb_scale, sizeof(glfw->fb_scale));
+    hash = nk_glfw3_hash(hash, nk_buffer_memory_const(&ctx->memory), ctx->memory.allocated);
+
+    if (!glfw->frame_hash || hash != glfw->frame_hash) {
+        glfw->frame_hash = hash;
+        return nk_false;
+    }
+    glfw->stats.skipped_frames++;
+    nk_clear(ctx);
+    if (glfw->frame_end)
+        glfw->frame_end(glfw->frame_end_user);
+    return nk_true;
+}
 
-    /* default OpenGL state */
-    glUseProgram(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glDisable(GL_BLEND);
-    glDisable(GL_SCISSOR_TEST);
+NK_API void
+nk_glfw3_memory(const struct nk_glfw* glfw, struct nk_glfw_memory *memory)
+{
+    const struct nk_glfw_device *dev = &glfw->ogl;
+    const struct nk_page *page;
+    int i;
+
+    memory->context = glfw->ctx.memory.memory.size;
+    for (page = glfw->ctx.pool.pages; page; page = page->next)
+        memory->context += sizeof(struct nk_page) + (glfw->ctx.pool.capacity - 1) * sizeof(struct nk_page_element);
+
+    memory->converted = dev->cmds.memory.size + dev->retained_vbuf.memory.size + dev->retained_ebuf.memory.size;
+    memory->converted += (nk_size)dev->batch_capacity * sizeof(struct nk_glfw_draw_cmd);
+    for (i = 0; i < NK_GLFW_RETAINED_WINDOWS; ++i)
+        memory->converted += (nk_size)dev->windows[i].batch_capacity * sizeof(struct nk_glfw_draw_cmd);
+
+    memory->gl_buffers = (nk_size)NK_GLFW_RING_FRAMES * (nk_size)(dev->slot_vertex_size + dev->slot_element_size);
+    memory->gl_buffers += (nk_size)(dev->retained_vertex_size + dev->retained_element_size);
+}
+
+NK_API void
+nk_glfw3_frame_init(struct nk_glfw_frame *frame)
+{
+    memset(frame, 0, sizeof(*frame));
+    nk_buffer_init_default(&frame->vbuf);
+    nk_buffer_init_default(&frame->ebuf);
+}
+
+NK_API void
+nk_glfw3_frame_free(struct nk_glfw_frame *frame)
+{
+    nk_buffer_free(&frame->vbuf);
+    nk_buffer_free(&frame->ebuf);
+    free(frame->cmds);
+    memset(frame, 0, sizeof(*frame));
+}
+
+NK_API void
+nk_glfw3_convert(struct nk_glfw* glfw, struct nk_glfw_frame *frame, enum nk_anti_aliasing AA)
+{
+    /* no GL calls in here, so the next frame can be converted while the
+     * previous one is still being submitted */
+    struct nk_glfw_device *dev = &glfw->ogl;
+    struct nk_convert_config config;
+
+    frame->width = glfw->width;
+    frame->height = glfw->height;
+    frame->display_width = glfw->display_width;
+    frame->display_height = glfw->display_height;
+    frame->fb_scale = glfw->fb_scale;
+    frame->cmd_count = 0;
+    nk_buffer_clear(&frame->vbuf);
+    nk_buffer_clear(&frame->ebuf);
+
+    /* the frame buffers grow on demand, so nothing is ever dropped */
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_CONVERT, nk_true);
+    nk_glfw3_convert_config(dev, AA, &config);
+    nk_convert(&glfw->ctx, &dev->cmds, &frame->vbuf, &frame->ebuf, &config);
+
+    frame->cmd_count = nk_glfw3_batch(&glfw->ctx, &dev->cmds, frame->height,
+        frame->display_width, frame->display_height, frame->fb_scale,
+        &frame->cmds, &frame->cmd_capacity, &frame->command_count);
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_CONVERT, nk_false);
+    nk_clear(&glfw->ctx);
+    nk_buffer_clear(&dev->cmds);
+    if (glfw->frame_end)
+        glfw->frame_end(glfw->frame_end_user);
+}
+
+NK_API void
+nk_glfw3_submit(struct nk_glfw* glfw, const struct nk_glfw_frame *frame)
+{
+    struct nk_glfw_device *dev = &glfw->ogl;
+    void *vertices, *elements;
+    double start = glfwGetTime(), upload_start;
+
+    nk_glfw3_ring_reserve(dev, (GLsizeiptr)frame->vbuf.allocated, (GLsizeiptr)frame->ebuf.allocated);
+    nk_glfw3_count_geometry(&glfw->stats, frame->vbuf.allocated, frame->ebuf.allocated);
+    nk_glfw3_begin_draw(dev, frame->width, frame->height, frame->display_width, frame->display_height);
+
+    /* copy the converted geometry into this frame's ring slot */
+    upload_start = glfwGetTime();
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_UPLOAD, nk_true);
+    nk_glfw3_ring_map(dev, &glfw->stats, &vertices, &elements);
+    memcpy(vertices, nk_buffer_memory_const(&frame->vbuf), frame->vbuf.allocated);
+    memcpy(elements, nk_buffer_memory_const(&frame->ebuf), frame->ebuf.allocated);
+    nk_glfw3_ring_unmap(dev);
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_UPLOAD, nk_false);
+    glfw->stats.upload_ms_total += (glfwGetTime() - upload_start) * 1000.0;
+
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_DRAW, nk_true);
+    nk_glfw3_draw_batches(dev, frame->cmds, frame->cmd_count,
+        nk_glfw3_ring_element_offset(dev), nk_glfw3_ring_base_vertex(dev));
+    nk_glfw3_phase(glfw, NK_GLFW_PHASE_DRAW, nk_false);
+    nk_glfw3_count_draws(&glfw->stats, frame->command_count, frame->cmd_count);
+    nk_glfw3_ring_advance(dev);
+    nk_glfw3_end_draw();
+    nk_glfw3_count_render(&glfw->stats, start);
 }
 
 NK_API void
@@ -392,6 +1362,31 @@ nk_glfw3_mouse_button_callback(GLFWwindow* win, int button, int action, int mods
     } else glfw->is_double_click_down = nk_false;
 }
 
+/* The window was exposed, restored or (un)covered and what is on screen
+ * can't be trusted, so the next frame is drawn and swapped even if it hashes
+ * the same as the last one (a non-composited desktop would keep it stale) */
+NK_API void
+nk_glfw3_refresh_callback(GLFWwindow *win)
+{
+    struct nk_glfw* glfw = (struct nk_glfw *)glfwGetWindowUserPointer(win);
+    glfw->frame_hash = 0;
+    glfwPostEmptyEvent();
+}
+
+NK_API void
+nk_glfw3_iconify_callback(GLFWwindow *win, int iconified)
+{
+    NK_UNUSED(iconified);
+    nk_glfw3_refresh_callback(win);
+}
+
+NK_API void
+nk_glfw3_focus_callback(GLFWwindow *win, int focused)
+{
+    NK_UNUSED(focused);
+    nk_glfw3_refresh_callback(win);
+}
+
 NK_INTERN void
 nk_glfw3_clipboard_paste(nk_handle usr, struct nk_text_edit *edit)
 {
@@ -425,6 +1420,9 @@ nk_glfw3_init(struct nk_glfw* glfw, GLFWwindow *win, enum nk_glfw_init_state ini
         glfwSetCharCallback(win, nk_glfw3_char_callback);
         glfwSetKeyCallback(win, nk_glfw3_key_callback);
         glfwSetMouseButtonCallback(win, nk_glfw3_mouse_button_callback);
+        glfwSetWindowRefreshCallback(win, nk_glfw3_refresh_callback);
+        glfwSetWindowIconifyCallback(win, nk_glfw3_iconify_callback);
+        glfwSetWindowFocusCallback(win, nk_glfw3_focus_callback);
     }
     nk_init_default(&glfw->ctx, 0);
     glfw->ctx.clip.copy = nk_glfw3_clipboard_copy;
@@ -460,19 +1458,56 @@ nk_glfw3_font_stash_end(struct nk_glfw* glfw)
         nk_style_set_font(&glfw->ctx, &glfw->atlas.default_font->handle);
 }
 
+NK_INTERN void
+nk_glfw3_gather_input(struct nk_glfw* glfw, struct nk_glfw_input *in)
+{
+    struct GLFWwindow *win = glfw->win;
+    double x, y;
+    float now = (float)glfwGetTime();
+    in->delta_time = now - glfw->delta_time_seconds_last;
+    glfw->delta_time_seconds_last = now;
+
+    glfwGetCursorPos(win, &x, &y);
+    in->x = (int)x;
+    in->y = (int)y;
+    in->buttons = 0;
+    if (glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) in->buttons |= 1 << NK_BUTTON_LEFT;
+    if (glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_MIDDLE) == GLFW_PRESS) in->buttons |= 1 << NK_BUTTON_MIDDLE;
+    if (glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS) in->buttons |= 1 << NK_BUTTON_RIGHT;
+    in->double_click = glfw->is_double_click_down;
+    in->double_click_pos = glfw->double_click_pos;
+    in->scroll = glfw->scroll;
+
+    in->held = 0;
+    if (glfwGetKey(win, GLFW_KEY_HOME) == GLFW_PRESS) in->held |= NK_GLFW_HELD_HOME;
+    if (glfwGetKey(win, GLFW_KEY_END) == GLFW_PRESS) in->held |= NK_GLFW_HELD_END;
+    if (glfwGetKey(win, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS ||
+        glfwGetKey(win, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS) in->held |= NK_GLFW_HELD_SHIFT;
+    if (glfwGetKey(win, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS ||
+        glfwGetKey(win, GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS) in->held |= NK_GLFW_HELD_CONTROL;
+    memcpy(in->key_events, glfw->key_events, sizeof(in->key_events));
+    memcpy(in->text, glfw->text, (size_t)glfw->text_len * sizeof(in->text[0]));
+    in->text_len = glfw->text_len;
+
+    /* clear what the callbacks collected (-1 since we're doing up/down boolean) */
+    memset(glfw->key_events, -1, sizeof(glfw->key_events));
+    glfw->text_len = 0;
+    glfw->scroll = nk_vec2(0,0);
+}
+
 NK_API void
 nk_glfw3_new_frame(struct nk_glfw* glfw)
 {
     int i;
-    double x, y;
     struct nk_context *ctx = &glfw->ctx;
     struct GLFWwindow *win = glfw->win;
-    nk_char* k_state = glfw->key_events;
+    struct nk_glfw_input in;
+    const nk_char* k_state = in.key_events;
 
-    /* update the timer */
-    float delta_time_now = (float)glfwGetTime();
-    glfw->ctx.delta_time_seconds = delta_time_now - glfw->delta_time_seconds_last;
-    glfw->delta_time_seconds_last = delta_time_now;
+    nk_glfw3_gather_input(glfw, &in);
+    if (glfw->input)
+        glfw->input(glfw->input_user, &in);
+    glfw->ctx.delta_time_seconds = in.delta_time;
 
     glfwGetWindowSize(win, &glfw->width, &glfw->height);
     glfwGetFramebufferSize(win, &glfw->display_width, &glfw->display_height);
@@ -480,8 +1515,8 @@ nk_glfw3_new_frame(struct nk_glfw* glfw)
     glfw->fb_scale.y = (float)glfw->display_height/(float)glfw->height;
 
     nk_input_begin(ctx);
-    for (i = 0; i < glfw->text_len; ++i)
-        nk_input_unicode(ctx, glfw->text[i]);
+    for (i = 0; i < in.text_len; ++i)
+        nk_input_unicode(ctx, in.text[i]);
 
 #ifdef NK_GLFW_GL3_MOUSE_GRABBING
     /* optional grabbing behavior */
@@ -501,15 +1536,13 @@ nk_glfw3_new_frame(struct nk_glfw* glfw)
     if (k_state[NK_KEY_SCROLL_UP] >= 0) nk_input_key(ctx, NK_KEY_SCROLL_UP, k_state[NK_KEY_SCROLL_UP]);
     if (k_state[NK_KEY_SCROLL_DOWN] >= 0) nk_input_key(ctx, NK_KEY_SCROLL_DOWN, k_state[NK_KEY_SCROLL_DOWN]);
 
-    nk_input_key(ctx, NK_KEY_TEXT_START, glfwGetKey(win, GLFW_KEY_HOME) == GLFW_PRESS);
-    nk_input_key(ctx, NK_KEY_TEXT_END, glfwGetKey(win, GLFW_KEY_END) == GLFW_PRESS);
-    nk_input_key(ctx, NK_KEY_SCROLL_START, glfwGetKey(win, GLFW_KEY_HOME) == GLFW_PRESS);
-    nk_input_key(ctx, NK_KEY_SCROLL_END, glfwGetKey(win, GLFW_KEY_END) == GLFW_PRESS);
-    nk_input_key(ctx, NK_KEY_SHIFT, glfwGetKey(win, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS||
-                                    glfwGetKey(win, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS);
+    nk_input_key(ctx, NK_KEY_TEXT_START, (in.held & NK_GLFW_HELD_HOME) != 0);
+    nk_input_key(ctx, NK_KEY_TEXT_END, (in.held & NK_GLFW_HELD_END) != 0);
+    nk_input_key(ctx, NK_KEY_SCROLL_START, (in.held & NK_GLFW_HELD_HOME) != 0);
+    nk_input_key(ctx, NK_KEY_SCROLL_END, (in.held & NK_GLFW_HELD_END) != 0);
+    nk_input_key(ctx, NK_KEY_SHIFT, (in.held & NK_GLFW_HELD_SHIFT) != 0);
 
-    if (glfwGetKey(win, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS ||
-        glfwGetKey(win, GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS) {
+    if (in.held & NK_GLFW_HELD_CONTROL) {
         /* Note these are physical keys and won't respect any layouts/key mapping */
         if (k_state[NK_KEY_COPY] >= 0) nk_input_key(ctx, NK_KEY_COPY, k_state[NK_KEY_COPY]);
         if (k_state[NK_KEY_PASTE] >= 0) nk_input_key(ctx, NK_KEY_PASTE, k_state[NK_KEY_PASTE]);
@@ -529,8 +1562,7 @@ nk_glfw3_new_frame(struct nk_glfw* glfw)
         nk_input_key(ctx, NK_KEY_CUT, 0);
     }
 
-    glfwGetCursorPos(win, &x, &y);
-    nk_input_motion(ctx, (int)x, (int)y);
+    nk_input_motion(ctx, in.x, in.y);
 #ifdef NK_GLFW_GL3_MOUSE_GRABBING
     if (ctx->input.mouse.grabbed) {
         glfwSetCursorPos(glfw->win, ctx->input.mouse.prev.x, ctx->input.mouse.prev.y);
@@ -538,18 +1570,12 @@ nk_glfw3_new_frame(struct nk_glfw* glfw)
         ctx->input.mouse.pos.y = ctx->input.mouse.prev.y;
     }
 #endif
-    nk_input_button(ctx, NK_BUTTON_LEFT, (int)x, (int)y, glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS);
-    nk_input_button(ctx, NK_BUTTON_MIDDLE, (int)x, (int)y, glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_MIDDLE) == GLFW_PRESS);
-    nk_input_button(ctx, NK_BUTTON_RIGHT, (int)x, (int)y, glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS);
-    nk_input_button(ctx, NK_BUTTON_DOUBLE, (int)glfw->double_click_pos.x, (int)glfw->double_click_pos.y, glfw->is_double_click_down);
-    nk_input_scroll(ctx, glfw->scroll);
+    nk_input_button(ctx, NK_BUTTON_LEFT, in.x, in.y, (in.buttons >> NK_BUTTON_LEFT) & 1);
+    nk_input_button(ctx, NK_BUTTON_MIDDLE, in.x, in.y, (in.buttons >> NK_BUTTON_MIDDLE) & 1);
+    nk_input_button(ctx, NK_BUTTON_RIGHT, in.x, in.y, (in.buttons >> NK_BUTTON_RIGHT) & 1);
+    nk_input_button(ctx, NK_BUTTON_DOUBLE, (int)in.double_click_pos.x, (int)in.double_click_pos.y, in.double_click);
+    nk_input_scroll(ctx, in.scroll);
     nk_input_end(&glfw->ctx);
-
-    /* clear after nk_input_end (-1 since we're doing up/down boolean) */
-    memset(glfw->key_events, -1, sizeof(glfw->key_events));
-
-    glfw->text_len = 0;
-    glfw->scroll = nk_vec2(0,0);
 }
 
 NK_API
@@ -0,0 +1,95 @@
+#ifndef PNG_WRITER_HPP
+#define PNG_WRITER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Writes RGBA pixels as an 8-bit RGB PNG. The image data is zlib stored
+// blocks rather than compressed, so this needs nothing beyond the standard
+// library; the files are about the size of the raw pixels. `pixels` is in
+// glReadPixels order, bottom row first.
+bool writePng(const string& path, int width, int height, const vector<uint8_t>& pixels) {
+	static uint32_t crcTable[256];
+	if (!crcTable[1]) {
+		for (uint32_t n = 0; n < 256; ++n) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; ++k) {
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			crcTable[n] = c;
+		}
+	}
+
+	ofstream out(path, ios::binary | ios::trunc);
+	auto put32 = [&](uint32_t value) {
+		char bytes[4] = {(char) (value >> 24), (char) (value >> 16), (char) (value >> 8), (char) value};
+		out.write(bytes, 4);
+	};
+	auto chunk = [&](const char *type, const vector<uint8_t>& data) {
+		put32((uint32_t) data.size());
+		out.write(type, 4);
+		out.write(reinterpret_cast<const char*>(data.data()), data.size());
+		uint32_t crc = 0xFFFFFFFFu;
+		for (int i = 0; i < 4; ++i) {
+			crc = crcTable[(crc ^ (uint8_t) type[i]) & 0xFF] ^ (crc >> 8);
+		}
+		for (uint8_t byte : data) {
+			crc = crcTable[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+		}
+		put32(crc ^ 0xFFFFFFFFu);
+	};
+
+	out.write("\x89PNG\r\n\x1a\n", 8);
+	vector<uint8_t> header = {
+		(uint8_t) (width >> 24), (uint8_t) (width >> 16), (uint8_t) (width >> 8), (uint8_t) width,
+		(uint8_t) (height >> 24), (uint8_t) (height >> 16), (uint8_t) (height >> 8), (uint8_t) height,
+		8, 2, 0, 0, 0 // 8 bits, RGB, deflate, adaptive filtering, no interlace
+	};
+	chunk("IHDR", header);
+
+	// Scanlines top down, each after a filter byte of 0
+	vector<uint8_t> raw;
+	raw.reserve((size_t) height * (width * 3 + 1));
+	for (int y = height - 1; y >= 0; --y) {
+		raw.push_back(0);
+		const uint8_t *row = &pixels[(size_t) y * width * 4];
+		for (int x = 0; x < width; ++x) {
+			raw.insert(raw.end(), row + x * 4, row + x * 4 + 3);
+		}
+	}
+
+	// zlib stream of stored blocks of up to 65535 bytes, then the Adler-32
+	vector<uint8_t> data = {0x78, 0x01};
+	data.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	for (size_t at = 0; at < raw.size() || at == 0; ) {
+		size_t length = min(raw.size() - at, (size_t) 65535);
+		bool last = at + length == raw.size();
+		data.push_back(last ? 1 : 0);
+		data.push_back((uint8_t) length);
+		data.push_back((uint8_t) (length >> 8));
+		data.push_back((uint8_t) ~length);
+		data.push_back((uint8_t) (~length >> 8));
+		data.insert(data.end(), raw.begin() + at, raw.begin() + at + length);
+		at += length;
+		if (last) {
+			break;
+		}
+	}
+	uint32_t a = 1, b = 0;
+	for (uint8_t byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	uint32_t adler = (b << 16) | a;
+	data.insert(data.end(), {(uint8_t) (adler >> 24), (uint8_t) (adler >> 16), (uint8_t) (adler >> 8), (uint8_t) adler});
+	chunk("IDAT", data);
+	chunk("IEND", {});
+	return (bool) out;
+}
+
+#endif // PNG_WRITER_HPP
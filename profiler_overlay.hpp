@@ -0,0 +1,103 @@
+#ifndef PROFILER_OVERLAY_HPP
+#define PROFILER_OVERLAY_HPP
+
+#include "frame_profiler.hpp"
+#include "frame_arena.hpp"
+#include "sql_trace.hpp"
+#include "memory_stats.hpp"
+
+// Profiler window: the recent frame times as a graph, min / avg / p99 of
+// every scope over the same frames, the previous frame's heap traffic and
+// the process's resident and SQLite memory.
+// Labels come from the frame arena, so showing it does not touch the heap.
+void drawProfilerOverlay(struct nk_context *ctx, const FrameProfiler& profiler, const AllocCounts& heap,
+                         FrameArena& frame) {
+	if (nk_begin(ctx, "Profiler", nk_rect(890, 318, 400, 377),
+			NK_WINDOW_BORDER | NK_WINDOW_TITLE | NK_WINDOW_MOVABLE | NK_WINDOW_NO_SCROLLBAR)) {
+		// Frame times, scaled to fit the slowest one but at least 30 fps
+		size_t frames = profiler.frames();
+		float slowest = 0;
+		for (size_t i = 0; i < frames; ++i) {
+			slowest = max(slowest, profiler.frameMs(i));
+		}
+		nk_layout_row_dynamic(ctx, 18, 1);
+		nk_label(ctx, frame.format("Frame time, last %zu frames (max %.1f ms)", frames, slowest), NK_TEXT_LEFT);
+		nk_layout_row_dynamic(ctx, 64, 1);
+		if (frames > 0 && nk_chart_begin(ctx, NK_CHART_COLUMN, (int) frames, 0, max(slowest, 1000.0f / 30))) {
+			for (size_t i = 0; i < frames; ++i) {
+				nk_chart_push(ctx, profiler.frameMs(i));
+			}
+			nk_chart_end(ctx);
+		}
+
+		// Breakdown in ms
+		float widths[] = {0.31f, 0.23f, 0.23f, 0.23f};
+		nk_layout_row(ctx, NK_DYNAMIC, 18, 4, widths);
+		nk_style_push_color(ctx, &ctx->style.text.color, nk_rgba(200, 200, 100, 255));
+		nk_label(ctx, "Scope (ms)", NK_TEXT_LEFT);
+		nk_label(ctx, "min", NK_TEXT_RIGHT);
+		nk_label(ctx, "avg", NK_TEXT_RIGHT);
+		nk_label(ctx, "p99", NK_TEXT_RIGHT);
+		nk_style_pop_color(ctx);
+		for (int scope = 0; scope < FrameProfiler::Scopes; ++scope) {
+			FrameProfiler::Summary s = profiler.summary((FrameProfiler::Scope) scope);
+			nk_layout_row(ctx, NK_DYNAMIC, 18, 4, widths);
+			nk_label(ctx, FrameProfiler::names[scope], NK_TEXT_LEFT);
+			nk_label(ctx, frame.number(s.min, 3), NK_TEXT_RIGHT);
+			nk_label(ctx, frame.number(s.avg, 3), NK_TEXT_RIGHT);
+			nk_label(ctx, frame.number(s.p99, 3), NK_TEXT_RIGHT);
+		}
+		nk_layout_row_dynamic(ctx, 18, 1);
+		nk_label(ctx, frame.format("Heap: %lu new, %lu delete, %lu B", heap.allocations, heap.frees, heap.bytes),
+		         NK_TEXT_LEFT);
+		ProcessMemory process = ProcessMemory::now();
+		SqliteMemory sqlite = SqliteMemory::now();
+		nk_label(ctx, frame.format("RSS %.1f MB (peak %.1f), SQLite %.1f MB", process.rss / 1048576.0,
+		                           process.peakRss / 1048576.0, sqlite.used / 1048576.0), NK_TEXT_LEFT);
+	}
+	nk_end(ctx);
+}
+
+// SQL trace window: the statement shapes that took the most time in total,
+// and a button that writes the whole table to `path`. `rows` is kept by the
+// caller so the snapshot reuses its memory.
+void drawSqlTraceOverlay(struct nk_context *ctx, const SqlTrace& trace, vector<SqlTrace::Row>& rows,
+                         FrameArena& frame, const string& path) {
+	if (nk_begin(ctx, "SQL trace", nk_rect(10, 380, 730, 310),
+			NK_WINDOW_BORDER | NK_WINDOW_TITLE | NK_WINDOW_MOVABLE | NK_WINDOW_NO_SCROLLBAR)) {
+		trace.snapshot(rows);
+		unsigned long frames = max(trace.frames(), 1ul);
+
+		nk_layout_row_dynamic(ctx, 25, 2);
+		nk_label(ctx, frame.format("%zu statements over %lu frames", rows.size(), frames), NK_TEXT_LEFT);
+		if (nk_button_label(ctx, frame.concat("Write ", path))) {
+			if (trace.writeDump(path)) {
+				cerr << "SQL trace written to " << path << endl;
+			} else {
+				cerr << "Can't write " << path << endl;
+			}
+		}
+
+		float widths[] = {0.13f, 0.12f, 0.11f, 0.11f, 0.53f};
+		nk_layout_row(ctx, NK_DYNAMIC, 18, 5, widths);
+		nk_style_push_color(ctx, &ctx->style.text.color, nk_rgba(200, 200, 100, 255));
+		nk_label(ctx, "per frame", NK_TEXT_RIGHT);
+		nk_label(ctx, "mean us", NK_TEXT_RIGHT);
+		nk_label(ctx, "p99 us", NK_TEXT_RIGHT);
+		nk_label(ctx, "total ms", NK_TEXT_RIGHT);
+		nk_label(ctx, "  statement", NK_TEXT_LEFT);
+		nk_style_pop_color(ctx);
+		for (size_t i = 0; i < min(rows.size(), (size_t) 10); ++i) {
+			const SqlTrace::Row& row = rows[i];
+			nk_layout_row(ctx, NK_DYNAMIC, 18, 5, widths);
+			nk_label(ctx, frame.number((double) row.calls / frames, 3), NK_TEXT_RIGHT);
+			nk_label(ctx, frame.number(row.meanUs, 1), NK_TEXT_RIGHT);
+			nk_label(ctx, frame.number(row.p99Us, 1), NK_TEXT_RIGHT);
+			nk_label(ctx, frame.number(row.totalMs, 2), NK_TEXT_RIGHT);
+			nk_label(ctx, frame.concat("  ", *row.shape), NK_TEXT_LEFT);
+		}
+	}
+	nk_end(ctx);
+}
+
+#endif // PROFILER_OVERLAY_HPP
@@ -0,0 +1,330 @@
+#ifndef PURCHASE_GENERATOR_HPP
+#define PURCHASE_GENERATOR_HPP
+
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "helpers.hpp"
+
+// Synthetic purchase history for benchmarks and stress tests.
+//
+// Output depends only on the options: the random numbers come from our own
+// xoshiro256** and are shaped by hand, since the <random> distributions differ
+// between standard libraries, and timestamps are formatted from day numbers
+// instead of going through the local time zone. Only the default end date
+// (today) changes from run to run; pass one to get byte-identical databases.
+//
+// Purchases come in shopping trips during the day, in date order like the app
+// records them. Item popularity follows a Zipf law over a catalog whose types
+// are drawn from typeMix; prices drift up by priceDrift a year with a little
+// noise, and a fraction of rows repeats the previous one exactly, the way a
+// double-submitted form does.
+struct GeneratorOptions {
+	long rows = 100000;
+	int days = 365;
+	long endDay = -1;     // days since 1970-01-01 of the last day; -1 is today
+	int items = 500;      // catalog size
+	double zipf = 1.1;    // popularity exponent, 0 is uniform
+	double basket = 4;    // mean purchases per trip
+	double priceDrift = 0.03;
+	double duplicates = 0.01;
+	vector<pair<string, double>> typeMix = {
+		{"food", 55}, {"drink", 20}, {"household", 12}, {"clothes", 8}, {"other", 5}};
+	uint64_t seed = 1;
+};
+
+struct GeneratedPurchase {
+	const char *name;
+	const char *type;
+	double quantity;
+	double price;
+	char timeStamp[20];
+	bool duplicate; // same as the previous row
+};
+
+class PurchaseGenerator {
+public:
+	explicit PurchaseGenerator(const GeneratorOptions& options) : options(options) {
+		uint64_t s = options.seed;
+		for (uint64_t& word : state) {
+			word = splitMix(s);
+		}
+		if (this->options.endDay < 0) {
+			this->options.endDay = (long) (time(nullptr) / 86400);
+		}
+		buildCatalog();
+		// Up to a minute between the items of a trip, less when trips are so
+		// dense that they would overlap
+		itemGap = min(59.0, this->options.days * 13 * 3600.0 / max(this->options.rows, 1L));
+	}
+
+	// The catalog points into options
+	PurchaseGenerator(const PurchaseGenerator&) = delete;
+	PurchaseGenerator& operator=(const PurchaseGenerator&) = delete;
+
+	// Fills `out` with the next purchase; call while !done()
+	void next(GeneratedPurchase& out) {
+		if (produced > 0 && uniform() < options.duplicates) {
+			out.duplicate = true;
+			produced++;
+			return;
+		}
+		out.duplicate = false;
+
+		if (tripLeft == 0) {
+			startTrip();
+		}
+		tripLeft--;
+		tripSeconds += 1 + (long) (uniform() * itemGap);
+
+		const Item& item = catalog[pickItem()];
+		double years = (tripDay - firstDay()) / 365.0;
+		double price = item.basePrice * pow(1 + options.priceDrift, years) * (0.95 + 0.1 * uniform());
+		int quantity = 1;
+		while (quantity < 12 && uniform() < 0.25) {
+			quantity++;
+		}
+
+		out.name = item.name.c_str();
+		out.type = item.type->c_str();
+		out.quantity = quantity;
+		out.price = round(price * 100) / 100;
+		formatTimeStamp(tripDay, min(tripSeconds, 86399L), out.timeStamp);
+		produced++;
+	}
+
+	bool done() const {
+		return produced >= options.rows;
+	}
+
+	// Catalog entries, most popular first
+	const string& itemName(int rank) const {
+		return catalog[rank].name;
+	}
+
+	int itemCount() const {
+		return (int) catalog.size();
+	}
+
+private:
+	struct Item {
+		string name;
+		const string *type;
+		double basePrice;
+	};
+
+	static uint64_t splitMix(uint64_t& s) {
+		uint64_t z = (s += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	static uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	uint64_t nextBits() {
+		uint64_t result = rotl(state[1] * 5, 7) * 9;
+		uint64_t t = state[1] << 17;
+		state[2] ^= state[0];
+		state[3] ^= state[1];
+		state[1] ^= state[2];
+		state[0] ^= state[3];
+		state[2] ^= t;
+		state[3] = rotl(state[3], 45);
+		return result;
+	}
+
+	// [0, 1)
+	double uniform() {
+		return (nextBits() >> 11) * 0x1.0p-53;
+	}
+
+	long firstDay() const {
+		return options.endDay - options.days + 1;
+	}
+
+	// A trip's day follows from how far through the rows it starts, so the
+	// history covers the span evenly; shops are open from 8:00 to 21:00
+	void startTrip() {
+		double position = (produced + uniform()) / max(options.rows, 1L) * options.days;
+		long day = firstDay() + min((long) position, (long) options.days - 1);
+		long seconds = 8 * 3600 + (long) ((position - floor(position)) * 13 * 3600);
+		tripSeconds = day > tripDay ? seconds : max(tripSeconds, seconds);
+		tripDay = max(tripDay, day);
+		tripLeft = 1;
+		while (uniform() > 1 / max(options.basket, 1.0)) {
+			tripLeft++;
+		}
+	}
+
+	int pickItem() {
+		return (int) (upper_bound(popularity.begin(), popularity.end(), uniform() * popularity.back()) - popularity.begin());
+	}
+
+	void buildCatalog() {
+		static const vector<pair<string, vector<string>>> nouns = {
+			{"food", {"bread", "milk", "eggs", "apples", "bananas", "rice", "pasta", "cheese", "butter", "chicken",
+			          "tomatoes", "potatoes", "onions", "yogurt", "cereal", "beef", "carrots", "flour", "sugar", "oranges"}},
+			{"drink", {"water", "coffee", "tea", "juice", "soda", "beer", "wine", "lemonade"}},
+			{"household", {"soap", "detergent", "paper towels", "toilet paper", "sponges", "trash bags", "light bulbs", "batteries"}},
+			{"clothes", {"socks", "t-shirt", "jeans", "jacket", "shoes", "gloves"}},
+			{"other", {"stamps", "magazine", "flowers", "gift card", "phone credit"}},
+		};
+		static const char *qualifiers[] = {"organic", "large", "small", "fresh", "frozen", "premium", "budget", "local"};
+		const int qualifierCount = 8;
+
+		double totalWeight = 0;
+		for (const auto& [type, weight] : options.typeMix) {
+			totalWeight += weight;
+		}
+		vector<int> perType(options.typeMix.size(), 0);
+		double cumulative = 0;
+		for (int i = 0; i < max(options.items, 1); ++i) {
+			size_t t = 0;
+			double pick = uniform() * totalWeight;
+			for (double sum = options.typeMix[0].second; t + 1 < options.typeMix.size() && pick >= sum; ) {
+				sum += options.typeMix[++t].second;
+			}
+			const string& type = options.typeMix[t].first;
+
+			vector<string> fallback = {type};
+			const vector<string> *names = &fallback;
+			for (const auto& [known, list] : nouns) {
+				if (known == type) {
+					names = &list;
+				}
+			}
+			int k = perType[t]++;
+			int pass = k / (int) names->size();
+			string name = (*names)[k % names->size()];
+			if (pass > 0) {
+				name = string(qualifiers[(pass - 1) % qualifierCount]) + " " + name;
+			}
+			if (pass > qualifierCount) {
+				name += " " + to_string((pass - 1) / qualifierCount + 1);
+			}
+
+			// Log-uniform between 0.5 and 50, clothes cost more
+			double basePrice = 0.5 * pow(100, uniform()) * (type == "clothes" ? 4 : 1);
+			catalog.push_back({name, &options.typeMix[t].first, basePrice});
+
+			cumulative += 1 / pow(i + 1, options.zipf);
+			popularity.push_back(cumulative);
+		}
+	}
+
+	// YYYY-MM-DD HH:MM:SS from days since the epoch (Hinnant's civil_from_days)
+	static void formatTimeStamp(long day, long seconds, char *out) {
+		long z = day + 719468;
+		long era = (z >= 0 ? z : z - 146096) / 146097;
+		long doe = z - era * 146097;
+		long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		long mp = (5 * doy + 2) / 153;
+		long d = doy - (153 * mp + 2) / 5 + 1;
+		long m = mp < 10 ? mp + 3 : mp - 9;
+		long y = yoe + era * 400 + (m <= 2);
+
+		long fields[] = {y / 100, y % 100, m, d, seconds / 3600, seconds / 60 % 60, seconds % 60};
+		const char separators[] = {0, 0, '-', '-', ' ', ':', ':'};
+		char *at = out;
+		for (int i = 0; i < 7; ++i) {
+			if (separators[i]) {
+				*at++ = separators[i];
+			}
+			*at++ = (char) ('0' + fields[i] / 10);
+			*at++ = (char) ('0' + fields[i] % 10);
+		}
+		*at = '\0';
+	}
+
+	GeneratorOptions options;
+	uint64_t state[4];
+	vector<Item> catalog;
+	vector<double> popularity; // cumulative Zipf weights
+	long produced = 0;
+	long tripDay = LONG_MIN;
+	long tripSeconds = 0;
+	long tripLeft = 0;
+	double itemGap = 59;
+};
+
+// INSERT of `rows` purchases at once; SQLite runs one multi-row statement
+// several times faster per row than the single-row one
+sqlite3_stmt* prepareGeneratedInsert(sqlite3 *db, int rows) {
+	string command = "INSERT INTO main.purchases (name, quantity, price, timeStamp, type) VALUES (?, ?, ?, ?, ?)";
+	for (int i = 1; i < rows; ++i) {
+		command += ", (?, ?, ?, ?, ?)";
+	}
+	sqlite3_stmt *stmt;
+	sqlite3_prepare_v2(db, command.c_str(), -1, &stmt, nullptr);
+	return stmt;
+}
+
+// Appends options.rows generated purchases to the database in one transaction.
+// Journaling and syncing are off while it runs, so only use it on a database
+// nothing else has open; the journal mode is WAL again afterwards. False, with
+// nothing added, if another connection holds the database after all.
+bool generatePurchases(sqlite3 *db, const GeneratorOptions& options) {
+	const int batchRows = 100; // 500 parameters, under SQLite's old limit of 999
+	createSchema(db);
+	runCommand(db, "PRAGMA journal_mode=OFF;");
+	runCommand(db, "PRAGMA synchronous=OFF;");
+	auto restore = [db] {
+		runCommand(db, "PRAGMA synchronous=FULL;");
+		runCommand(db, "PRAGMA journal_mode=WAL;");
+	};
+	// IMMEDIATE, so a lock held elsewhere shows up here and not half way in
+	if (runCommand(db, "BEGIN IMMEDIATE;") != SQLITE_OK) {
+		restore();
+		return false;
+	}
+
+	sqlite3_stmt *batch = prepareGeneratedInsert(db, batchRows);
+	sqlite3_stmt *single = prepareGeneratedInsert(db, 1);
+	PurchaseGenerator generator(options);
+	vector<GeneratedPurchase> rows(batchRows);
+	int previous = 0;
+	long left = options.rows;
+	while (left > 0) {
+		sqlite3_stmt *stmt = left >= batchRows ? batch : single;
+		int count = stmt == batch ? batchRows : 1;
+		for (int i = 0; i < count; ++i) {
+			// A duplicate leaves the previous row in place
+			GeneratedPurchase& p = rows[i];
+			p = rows[i > 0 ? i - 1 : previous];
+			generator.next(p);
+			sqlite3_bind_text(stmt, i * 5 + 1, p.name, -1, SQLITE_STATIC);
+			sqlite3_bind_double(stmt, i * 5 + 2, p.quantity);
+			sqlite3_bind_double(stmt, i * 5 + 3, p.price);
+			sqlite3_bind_text(stmt, i * 5 + 4, p.timeStamp, -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmt, i * 5 + 5, p.type, -1, SQLITE_STATIC);
+		}
+		if (sqlite3_step(stmt) != SQLITE_DONE) {
+			cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
+			sqlite3_finalize(batch);
+			sqlite3_finalize(single);
+			sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+			restore();
+			return false;
+		}
+		sqlite3_reset(stmt);
+		previous = count - 1;
+		left -= count;
+	}
+	sqlite3_finalize(batch);
+	sqlite3_finalize(single);
+
+	bool committed = runCommand(db, "COMMIT;") == SQLITE_OK;
+	if (!committed) {
+		sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+	}
+	restore();
+	return committed;
+}
+
+#endif // PURCHASE_GENERATOR_HPP
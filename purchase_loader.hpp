@@ -0,0 +1,188 @@
+#ifndef PURCHASE_LOADER_HPP
+#define PURCHASE_LOADER_HPP
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "write_queue.hpp"
+#include "purchase_table.hpp"
+
+// Coroutine that walks loadPurchasesQuery and yields the rows in chunks.
+// Destroying it mid-way finalizes the statement, which cancels the load.
+class PurchaseStream {
+public:
+	struct promise_type {
+		vector<Purchase> *chunk = nullptr;
+
+		PurchaseStream get_return_object() {
+			return PurchaseStream(coroutine_handle<promise_type>::from_promise(*this));
+		}
+		suspend_always initial_suspend() noexcept { return {}; }
+		suspend_always final_suspend() noexcept { return {}; }
+		suspend_always yield_value(vector<Purchase>& rows) {
+			chunk = &rows;
+			return {};
+		}
+		void return_void() {}
+		void unhandled_exception() { terminate(); }
+	};
+
+	PurchaseStream() = default;
+	PurchaseStream(PurchaseStream&& other) noexcept : handle(exchange(other.handle, nullptr)) {}
+	PurchaseStream& operator=(PurchaseStream&& other) noexcept {
+		if (this != &other) {
+			reset();
+			handle = exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+	~PurchaseStream() {
+		reset();
+	}
+
+	// Runs the coroutine up to its next chunk; false once the rows ran out
+	bool next() {
+		if (!handle || handle.done()) {
+			return false;
+		}
+		handle.resume();
+		return !handle.done();
+	}
+
+	vector<Purchase>& chunk() {
+		return *handle.promise().chunk;
+	}
+
+	void reset() {
+		if (handle) {
+			handle.destroy();
+			handle = nullptr;
+		}
+	}
+
+	explicit operator bool() const {
+		return handle != nullptr;
+	}
+
+private:
+	explicit PurchaseStream(coroutine_handle<promise_type> handle) : handle(handle) {}
+
+	coroutine_handle<promise_type> handle;
+};
+
+// Finalizes the statement when the coroutine frame goes away
+struct StatementHandle {
+	sqlite3_stmt *stmt = nullptr;
+	~StatementHandle() { sqlite3_finalize(stmt); }
+};
+
+PurchaseStream streamPurchases(sqlite3 *db, size_t chunkSize) {
+	StatementHandle query;
+
+	if (sqlite3_prepare_v2(db, loadPurchasesQuery, -1, &query.stmt, nullptr) != SQLITE_OK) {
+		co_return;
+	}
+
+	vector<Purchase> chunk;
+	chunk.reserve(chunkSize);
+	while (sqlite3_step(query.stmt) == SQLITE_ROW) {
+		chunk.push_back(readPurchase(query.stmt));
+		if (chunk.size() == chunkSize) {
+			co_yield chunk;
+			chunk.clear();
+		}
+	}
+	if (!chunk.empty()) {
+		co_yield chunk;
+	}
+}
+
+// Progressive loading of the purchases list, driven by the frame loop.
+//
+// Every frame pump() pulls chunks from the stream until the time budget is
+// spent, except that the first screenful of a (re)load always arrives in the
+// frame it starts in. When the write queue reports a change the running load
+// is cancelled and started over.
+class PurchaseLoader {
+public:
+	PurchaseLoader(size_t firstScreen = 32, chrono::microseconds budget = chrono::microseconds(2000), size_t chunkSize = 64)
+		: firstScreen(firstScreen), budget(budget), chunkSize(chunkSize) {}
+
+	void pump(WriteQueue& writes) {
+		if (!stale && !loading && writes.version() == loadedVersion) {
+			return;
+		}
+
+		writes.read([&](sqlite3 *db) {
+			// Checked again under the lock: no commit can slip in after this
+			if (stale || writes.version() != loadedVersion) {
+				restart(db, writes);
+			}
+
+			auto deadline = chrono::steady_clock::now() + budget;
+			while (loading && (rows.size() < firstScreen || chrono::steady_clock::now() < deadline)) {
+				if (!stream.next()) {
+					loading = false;
+					stream.reset();
+					break;
+				}
+				for (const Purchase& p : stream.chunk()) {
+					if (!overlay.isDeleted(p)) {
+						rows.append(p);
+					}
+				}
+			}
+			rows.finishAppending();
+		});
+	}
+
+	// Reload on the next pump(), for changes made behind the write queue's back
+	void invalidate() {
+		stale = true;
+	}
+
+	const vector<Purchase>& purchases() const {
+		return rows.purchases();
+	}
+
+	// The same rows with their display strings
+	const PurchaseTable& table() const {
+		return rows;
+	}
+
+	bool isLoading() const {
+		return loading;
+	}
+
+	// Nothing to load, and nothing the next pump() would start loading
+	bool isIdle(const WriteQueue& writes) const {
+		return !stale && !loading && writes.version() == loadedVersion;
+	}
+
+private:
+	void restart(sqlite3 *db, WriteQueue& writes) {
+		loadedVersion = writes.version();
+		overlay = writes.pending();
+		stream = streamPurchases(db, chunkSize);
+		rows.clear();
+		for (const Purchase& p : overlay.inserted) {
+			rows.append(p);
+		}
+		loading = true;
+		stale = false;
+	}
+
+	size_t firstScreen;
+	chrono::microseconds budget;
+	size_t chunkSize;
+
+	PurchaseStream stream;
+	WriteQueue::Overlay overlay;
+	PurchaseTable rows;
+	unsigned long loadedVersion = 0;
+	bool loading = false;
+	bool stale = true;
+};
+
+#endif // PURCHASE_LOADER_HPP
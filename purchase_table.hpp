@@ -0,0 +1,122 @@
+#ifndef PURCHASE_TABLE_HPP
+#define PURCHASE_TABLE_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+
+#include "helpers.hpp"
+#include "memory_stats.hpp"
+
+// Model behind the purchases table.
+//
+// Holds the purchases in display order together with their cell text, which
+// is formatted once when a row is added and kept null-terminated in a single
+// character arena. Drawing a row is then only pointer arithmetic. Day totals
+// are summed from the rows themselves and shown on each day's first (latest)
+// row; while a day is still streaming in, its total is refreshed per append().
+class PurchaseTable {
+public:
+	enum Column { Name, Type, Quantity, Total, Date, DayTotal, Columns };
+
+	void clear() {
+		rows.clear();
+		cells.clear();
+		text.assign(1, '\0'); // offset 0 is the empty string
+		dayStart = 0;
+		dayTotal = 0;
+		dayTotalDirty = false;
+	}
+
+	void append(const Purchase& p) {
+		size_t index = rows.size();
+		rows.push_back(p);
+
+		array<uint32_t, Columns> row;
+		row[Name] = store(p.name.c_str(), p.name.size());
+		row[Type] = store(p.type.c_str(), p.type.size());
+		row[Quantity] = storeNumber(p.quantity);
+		row[Total] = storeNumber(p.quantity * p.price);
+		row[Date] = store(p.timeStamp.c_str(), min(p.timeStamp.size(), (size_t) 10));
+		row[DayTotal] = 0;
+		cells.push_back(row);
+
+		if (index > 0 && strcmp(cell(index, Date), cell(index - 1, Date)) != 0) {
+			finishAppending(); // the previous day is complete
+			dayStart = index;
+			dayTotal = 0;
+		}
+		dayTotal += p.quantity * p.price;
+		dayTotalDirty = true;
+	}
+
+	// Call after a run of append()s to bring the open day's total up to date
+	void finishAppending() {
+		if (dayTotalDirty && !rows.empty()) {
+			cells[dayStart][DayTotal] = storeNumber(dayTotal);
+			dayTotalDirty = false;
+		}
+	}
+
+	const char* cell(size_t row, Column column) const {
+		return text.data() + cells[row][column];
+	}
+
+	const Purchase& operator[](size_t row) const {
+		return rows[row];
+	}
+
+	size_t size() const {
+		return rows.size();
+	}
+
+	const vector<Purchase>& purchases() const {
+		return rows;
+	}
+
+	// Bytes of cell text, including strings replaced by later day totals
+	size_t textBytes() const {
+		return text.size();
+	}
+
+	// Heap bytes held, by part: the Purchase structs, their strings'
+	// out-of-line text, the cell offsets and the cell text (all at capacity)
+	struct Footprint {
+		size_t purchases, strings, cells, text;
+
+		size_t total() const {
+			return purchases + strings + cells + text;
+		}
+	};
+
+	Footprint footprint() const {
+		Footprint f = {rows.capacity() * sizeof(Purchase), 0, cells.capacity() * sizeof(cells[0]), text.capacity()};
+		for (const Purchase& p : rows) {
+			f.strings += stringHeapBytes(p.name) + stringHeapBytes(p.timeStamp) + stringHeapBytes(p.type);
+		}
+		return f;
+	}
+
+private:
+	uint32_t store(const char *s, size_t length) {
+		uint32_t offset = (uint32_t) text.size();
+		text.insert(text.end(), s, s + length);
+		text.push_back('\0');
+		return offset;
+	}
+
+	uint32_t storeNumber(double value) {
+		char buffer[32];
+		int length = snprintf(buffer, sizeof(buffer), "%.2f", value);
+		return store(buffer, (size_t) length);
+	}
+
+	vector<Purchase> rows;
+	vector<array<uint32_t, Columns>> cells;
+	vector<char> text = vector<char>(1, '\0');
+	size_t dayStart = 0;
+	double dayTotal = 0;
+	bool dayTotalDirty = false;
+};
+
+#endif // PURCHASE_TABLE_HPP
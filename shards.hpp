@@ -0,0 +1,402 @@
+#ifndef SHARDS_HPP
+#define SHARDS_HPP
+
+#include <climits>
+#include <cstdio>
+#include <filesystem>
+#include <future>
+
+#include "helpers.hpp"
+
+// Year-sharded purchase history.
+//
+// Purchases from before the current year are moved out of data.db into one
+// archive database per year (data-2024.db, ...), which can live in a separate
+// directory on slower storage. The archives are ATTACHed read-only, and a TEMP
+// VIEW named `purchases` stitches them back together with the hot table, so
+// every existing query keeps working unchanged. The archives are indexed on
+// timeStamp, which lets SQLite merge them in date order for the list and skip
+// them with a single index probe for recent-data queries. The statistics
+// skip them altogether: they add up per shard through sum(), leaving out the
+// archives their date range cannot reach.
+//
+// SQLite attaches at most SQLITE_LIMIT_ATTACHED (10) databases, so once
+// there are more archives than that the oldest are merged into one that
+// holds several years (data-2015-2018.db).
+//
+// Archives are never written after the move. Deleting an archived purchase
+// records a tombstone (see PurchaseStatements) that the view filters out; the
+// tombstones are applied to the archives on the next archiveOldYears().
+// Inserts and deletes name main.purchases, since the view is read-only.
+class ShardSet {
+public:
+	struct Shard {
+		int firstYear, year; // the years it holds, one unless merged
+		string path;
+		sqlite3 *reader = nullptr; // own connection for parallel aggregation
+	};
+
+	ShardSet(sqlite3 *db, string hotPath, string archiveDir = ".")
+		: db(db), hotPath(hotPath), archiveDir(archiveDir) {
+		runCommand(db, "CREATE TABLE IF NOT EXISTS main.shards (year INTEGER PRIMARY KEY, path TEXT);");
+	}
+
+	~ShardSet() {
+		for (Shard& shard : shards) {
+			sqlite3_close(shard.reader);
+		}
+	}
+
+	ShardSet(const ShardSet&) = delete;
+	ShardSet& operator=(const ShardSet&) = delete;
+
+	// Moves every purchase older than the current year into its year's archive
+	// and applies pending tombstones. Call before attach(), and never on a
+	// copy of the hot database: the copy's registry names the same archives.
+	void archiveOldYears() {
+		int currentYear = localYear();
+		stringstream yearsQuery;
+		yearsQuery << "SELECT DISTINCT CAST(substr(timeStamp, 1, 4) AS INTEGER) FROM main.purchases "
+				   << "WHERE timeStamp < '" << currentYear << "-01-01';";
+		vector<int> years;
+		sqlite3_stmt *stmt;
+		if (sqlite3_prepare_v2(db, yearsQuery.str().c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+			while (sqlite3_step(stmt) == SQLITE_ROW) {
+				years.push_back(sqlite3_column_int(stmt, 0));
+			}
+		}
+		sqlite3_finalize(stmt);
+
+		if (!years.empty()) {
+			filesystem::create_directories(archiveDir);
+		}
+		for (int year : years) {
+			string path = registeredPath(year);
+			if (path.empty()) {
+				path = (filesystem::path(archiveDir) / (filesystem::path(hotPath).stem().string() + "-" + to_string(year) + ".db")).string();
+			}
+
+			stringstream range;
+			range << "timeStamp >= '" << year << "-01-01' AND timeStamp < '" << year + 1 << "-01-01'";
+
+			openArchive(path);
+			bool moved = transaction({
+				"INSERT OR REPLACE INTO archive.purchases SELECT id, name, quantity, price, timeStamp, type "
+				"FROM main.purchases WHERE " + range.str() + ";",
+				"DELETE FROM main.purchases WHERE " + range.str() + ";",
+				"INSERT OR REPLACE INTO main.shards (year, path) VALUES (" + to_string(year) + ", " + sqlQuote(path) + ");",
+			});
+			runCommand(db, "DETACH archive;");
+			if (!moved) {
+				cerr << "Can't archive " << year << " while another connection holds the database; "
+					 << "it stays in place until the next start" << endl;
+				return;
+			}
+		}
+
+		mergeOldest();
+		applyTombstones();
+	}
+
+	// Attaches the archives read-only and puts the `purchases` view over them.
+	// False if there are more than can be attached, which a view without the
+	// oldest years would hide.
+	bool attach() {
+		loadRegistry();
+
+		int maxAttached = sqlite3_limit(db, SQLITE_LIMIT_ATTACHED, -1);
+		if ((int) shards.size() > maxAttached) {
+			cerr << shards.size() << " archives, but only " << maxAttached << " can be attached; "
+				 << "archiveOldYears() merges the oldest" << endl;
+			return false;
+		}
+
+		string view = "CREATE TEMP VIEW purchases AS SELECT id, name, quantity, price, timeStamp, type FROM main.purchases";
+		vector<Shard> attached;
+		for (Shard& shard : shards) {
+			string schema = "shard_" + to_string(shard.year);
+			string command = "ATTACH " + sqlQuote(fileUri(shard.path, "ro")) + " AS " + schema + ";";
+			if (sqlite3_exec(db, command.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) {
+				cerr << "Can't attach archive " << shard.path << ": " << sqlite3_errmsg(db) << endl;
+				continue;
+			}
+			view += " UNION ALL SELECT id, name, quantity, price, timeStamp, type FROM " + schema + ".purchases"
+					" WHERE id NOT IN (SELECT id FROM main.purchase_tombstones)";
+			attached.push_back(shard);
+		}
+		shards = attached;
+		if (shards.empty()) {
+			return true;
+		}
+
+		runCommand(db, "DROP VIEW IF EXISTS temp.purchases;");
+		runCommand(db, view + ";");
+		return true;
+	}
+
+	// SUM(expr) over all shards: the hot table on this thread, every archive
+	// in parallel on its own read-only connection. Archives of years outside
+	// fromYear..toYear are skipped without a query.
+	double sum(const string& expr, const string& where = "1", int fromYear = 0, int toYear = INT_MAX) {
+		return aggregate("SUM(" + expr + ")", where, fromYear, toYear);
+	}
+
+	// Any aggregate whose per-shard results add up. An archive holds whole
+	// years, so COUNT(DISTINCT date(timeStamp)) does too.
+	double aggregate(const string& select, const string& where, int fromYear = 0, int toYear = INT_MAX) {
+		vector<future<double>> cold;
+		for (Shard& shard : shards) {
+			if (shard.year < fromYear || shard.firstYear > toYear) {
+				continue;
+			}
+			cold.push_back(async(launch::async, [this, &shard, select, where] {
+				tracer.nameThread("archive sum");
+				TraceSpan span("task", "Archive sum");
+				return queryDouble(reader(shard), "SELECT " + select + " FROM purchases WHERE (" + where + ") "
+												  "AND id NOT IN (SELECT id FROM hot.purchase_tombstones);");
+			}));
+		}
+
+		double total = queryDouble(db, "SELECT " + select + " FROM main.purchases WHERE " + where + ";");
+		for (future<double>& part : cold) {
+			total += part.get();
+		}
+		return total;
+	}
+
+	double totalSpent() {
+		return sum("quantity * price");
+	}
+
+	// The statistics window's figures, as the helpers.hpp functions of the
+	// same names compute them over the view
+	double totalSpent(int days) {
+		return sum("quantity * price", since(days), sinceYear(days));
+	}
+
+	double totalSpent(const string& name, int days) {
+		return sum("quantity * price", "name = " + sqlQuote(name) + " AND " + since(days), sinceYear(days));
+	}
+
+	double totalQuantity(const string& name, int days) {
+		return sum("quantity", "name = " + sqlQuote(name) + " AND " + since(days), sinceYear(days));
+	}
+
+	double totalSpentByType(const string& type, int days) {
+		return sum("quantity * price", "type = " + sqlQuote(type) + " AND " + since(days), sinceYear(days));
+	}
+
+	double totalSpentOnDate(const string& date) {
+		int year = atoi(date.c_str());
+		return sum("quantity * price", onDate(date), year, year);
+	}
+
+	// Over the days that have purchases, like AVG() over a GROUP BY day
+	double averageSpentPerDay(int days) {
+		double spendingDays = aggregate("COUNT(DISTINCT date(timeStamp))", since(days), sinceYear(days));
+		return spendingDays ? totalSpent(days) / spendingDays : 0;
+	}
+
+	const vector<Shard>& archives() const {
+		return shards;
+	}
+
+private:
+	static int localYear() {
+		time_t now = time(nullptr);
+		return localtime(&now)->tm_year + 1900;
+	}
+
+	static string since(int days) {
+		return "timeStamp >= date('now', '-" + to_string(days) + " day')";
+	}
+
+	// date('now', '-N day') is a UTC date, so its year is too; no archive of
+	// an earlier year holds anything that recent
+	static int sinceYear(int days) {
+		time_t then = time(nullptr) - (time_t) days * 86400;
+		return gmtime(&then)->tm_year + 1900;
+	}
+
+	static string sqlQuote(const string& text) {
+		string quoted = "'";
+		for (char c : text) {
+			quoted += c;
+			if (c == '\'') {
+				quoted += c;
+			}
+		}
+		return quoted + "'";
+	}
+
+	static string fileUri(const string& path, const char *mode) {
+		string uri = "file:";
+		for (char c : path) {
+			if (c == '%' || c == '?' || c == '#') {
+				char escaped[4];
+				snprintf(escaped, sizeof(escaped), "%%%02X", (unsigned char) c);
+				uri += escaped;
+			} else {
+				uri += c;
+			}
+		}
+		return uri + "?mode=" + mode;
+	}
+
+	static double queryDouble(sqlite3 *conn, const string& query) {
+		sqlite3_stmt *stmt;
+		double value = 0;
+		if (sqlite3_prepare_v2(conn, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+			if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+				value = sqlite3_column_double(stmt, 0);
+			}
+		}
+		sqlite3_finalize(stmt);
+		return value;
+	}
+
+	// Runs `commands` in one IMMEDIATE transaction. False, with everything
+	// rolled back, if the database stayed locked past the busy timeout.
+	bool transaction(initializer_list<string> commands) {
+		if (runCommand(db, "BEGIN IMMEDIATE;") != SQLITE_OK) {
+			return false;
+		}
+		for (const string& command : commands) {
+			if (runCommand(db, command) != SQLITE_OK) {
+				sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+				return false;
+			}
+		}
+		if (runCommand(db, "COMMIT;") != SQLITE_OK) {
+			sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+			return false;
+		}
+		return true;
+	}
+
+	void openArchive(const string& path) {
+		runCommand(db, "ATTACH " + sqlQuote(fileUri(path, "rwc")) + " AS archive;");
+		runCommand(db, "CREATE TABLE IF NOT EXISTS archive.purchases ("
+					   "id INTEGER PRIMARY KEY,"
+					   "name TEXT,"
+					   "quantity REAL,"
+					   "price REAL,"
+					   "timeStamp TEXT,"
+					   "type TEXT"
+					   ");");
+		runCommand(db, "CREATE INDEX IF NOT EXISTS archive.purchases_timeStamp ON purchases (timeStamp);");
+	}
+
+	string registeredPath(int year) {
+		loadRegistry();
+		for (const Shard& shard : shards) {
+			if (shard.firstYear <= year && year <= shard.year) {
+				return shard.path;
+			}
+		}
+		return "";
+	}
+
+	// One shard per archive file; the years of a merged one share its path
+	void loadRegistry() {
+		shards.clear();
+		sqlite3_stmt *stmt;
+		const char *query = "SELECT MIN(year), MAX(year), path FROM main.shards GROUP BY path ORDER BY MAX(year) DESC;";
+		if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) == SQLITE_OK) {
+			while (sqlite3_step(stmt) == SQLITE_ROW) {
+				Shard shard;
+				shard.firstYear = sqlite3_column_int(stmt, 0);
+				shard.year = sqlite3_column_int(stmt, 1);
+				shard.path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+				shards.push_back(shard);
+			}
+		}
+		sqlite3_finalize(stmt);
+	}
+
+	// Merges the oldest archives into one until all of them can be attached.
+	// Each source is copied in and re-registered in one transaction, then
+	// deleted; an archive that is offline stops the merge.
+	void mergeOldest() {
+		int maxAttached = sqlite3_limit(db, SQLITE_LIMIT_ATTACHED, -1);
+		loadRegistry();
+		if ((int) shards.size() <= maxAttached) {
+			return;
+		}
+
+		vector<Shard> oldest(shards.begin() + (maxAttached - 1), shards.end());
+		for (const Shard& shard : oldest) {
+			if (!filesystem::exists(shard.path)) {
+				cerr << "Can't merge old archives while " << shard.path << " is offline" << endl;
+				return;
+			}
+		}
+		string stem = filesystem::path(hotPath).stem().string();
+		string name = stem + "-" + to_string(oldest.back().firstYear) + "-" + to_string(oldest.front().year) + ".db";
+		string path = (filesystem::path(archiveDir) / name).string();
+
+		openArchive(path);
+		for (const Shard& shard : oldest) {
+			runCommand(db, "ATTACH " + sqlQuote(fileUri(shard.path, "ro")) + " AS merging;");
+			bool merged = transaction({
+				"INSERT OR REPLACE INTO archive.purchases SELECT id, name, quantity, price, timeStamp, type "
+				"FROM merging.purchases;",
+				"UPDATE main.shards SET path = " + sqlQuote(path) + " WHERE path = " + sqlQuote(shard.path) + ";",
+			});
+			runCommand(db, "DETACH merging;");
+			if (!merged) {
+				// The sources merged so far are registered to the new archive
+				runCommand(db, "DETACH archive;");
+				cerr << "Can't merge old archives while another connection holds the database" << endl;
+				return;
+			}
+			filesystem::remove(shard.path);
+		}
+		runCommand(db, "DETACH archive;");
+		cerr << "Merged the archives of " << oldest.back().firstYear << " to " << oldest.front().year << " into " << path << endl;
+	}
+
+	void applyTombstones() {
+		if (queryDouble(db, "SELECT COUNT(*) FROM main.purchase_tombstones;") == 0) {
+			return;
+		}
+
+		loadRegistry();
+		bool applied = true;
+		for (const Shard& shard : shards) {
+			if (!filesystem::exists(shard.path)) {
+				applied = false;
+				continue;
+			}
+			openArchive(shard.path);
+			if (runCommand(db, "DELETE FROM archive.purchases WHERE id IN (SELECT id FROM main.purchase_tombstones);")) {
+				applied = false;
+			}
+			runCommand(db, "DETACH archive;");
+		}
+		// Keep them around while an archive is offline
+		if (applied) {
+			runCommand(db, "DELETE FROM main.purchase_tombstones;");
+		}
+	}
+
+	sqlite3* reader(Shard& shard) {
+		if (!shard.reader) {
+			if (sqlite3_open_v2(fileUri(shard.path, "ro").c_str(), &shard.reader, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, nullptr)) {
+				cerr << "Can't open archive " << shard.path << ": " << sqlite3_errmsg(shard.reader) << endl;
+				return shard.reader;
+			}
+			sqlite3_busy_timeout(shard.reader, busyTimeoutMs);
+			sqlTrace.attach(shard.reader);
+			runCommand(shard.reader, "ATTACH " + sqlQuote(fileUri(hotPath, "ro")) + " AS hot;");
+		}
+		return shard.reader;
+	}
+
+	sqlite3 *db;
+	string hotPath;
+	string archiveDir;
+	vector<Shard> shards; // newest first
+};
+
+#endif // SHARDS_HPP
@@ -0,0 +1,267 @@
+#ifndef SQL_TRACE_HPP
+#define SQL_TRACE_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sqlite3.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "trace_recorder.hpp"
+
+using namespace std;
+
+// Latency histogram with HDR-style log-linear buckets: exact below 16 ns, then
+// 16 buckets per power of two, so any value is off by at most 1/16.
+class LatencyHistogram {
+public:
+	void record(uint64_t ns) {
+		counts[bucket(ns)]++;
+		total++;
+	}
+
+	uint64_t count() const {
+		return total;
+	}
+
+	// Upper end of the bucket holding the p-th percentile
+	uint64_t percentile(double p) const {
+		uint64_t target = max<uint64_t>((uint64_t) (p / 100 * total + 0.5), 1);
+		uint64_t seen = 0;
+		for (size_t i = 0; i < counts.size(); ++i) {
+			seen += counts[i];
+			if (seen >= target) {
+				return upperBound(i);
+			}
+		}
+		return 0;
+	}
+
+private:
+	static const int subBuckets = 16;
+	static const int magnitudes = 38; // up to 2^41 ns, about 37 minutes
+
+	static size_t bucket(uint64_t ns) {
+		if (ns < subBuckets) {
+			return ns;
+		}
+		int magnitude = min((int) bit_width(ns) - 4, magnitudes - 1);
+		int shift = magnitude - 1;
+		return magnitude * subBuckets + min<uint64_t>((ns >> shift) - subBuckets, subBuckets - 1);
+	}
+
+	static uint64_t upperBound(size_t index) {
+		if (index < subBuckets) {
+			return index;
+		}
+		int shift = (int) (index / subBuckets) - 1;
+		return ((subBuckets + index % subBuckets + 1) << shift) - 1;
+	}
+
+	array<uint64_t, subBuckets * magnitudes> counts{};
+	uint64_t total = 0;
+};
+
+// Per-statement SQL timings from sqlite3_trace_v2(SQLITE_TRACE_PROFILE).
+//
+// helpers.hpp builds its queries with the values spelled out, so statements
+// are grouped by shape: string and number literals become ?, and runs of
+// white space one space. Each shape keeps a call count, the total time and a
+// latency histogram. noteFrame() counts frames, to turn calls into calls per
+// frame. Connections opened while tracing is enabled are attached by
+// openDatabase(); the callback may run on any thread.
+//
+// The time SQLite passes to the PROFILE event comes from the VFS clock, which
+// only has millisecond resolution on Unix, so most statements would read 0.
+// A statement is timed from its STMT event to its PROFILE event instead.
+//
+// While the trace recorder is open, each statement also goes to the trace as
+// an event, with its full text.
+class SqlTrace {
+public:
+	struct Row {
+		const string *shape;
+		uint64_t calls;
+		double totalMs, meanUs, p50Us, p99Us, maxUs;
+	};
+
+	bool enabled() const {
+		return on;
+	}
+
+	// Affects connections attached afterwards
+	void setEnabled(bool enable) {
+		on = enable;
+	}
+
+	void attach(sqlite3 *db) {
+		if (on || tracer.enabled()) {
+			sqlite3_trace_v2(db, SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE, &SqlTrace::profile, this);
+		}
+	}
+
+	void noteFrame() {
+		lock_guard<mutex> lock(shapesMutex);
+		frameCount++;
+	}
+
+	unsigned long frames() const {
+		lock_guard<mutex> lock(shapesMutex);
+		return frameCount;
+	}
+
+	// Every shape, most total time first. Fills `rows` in place, so calling
+	// this once a frame does not allocate once the shapes are known.
+	void snapshot(vector<Row>& rows) const {
+		lock_guard<mutex> lock(shapesMutex);
+		rows.clear();
+		for (const auto& [shape, stats] : shapes) {
+			rows.push_back({&shape, stats.histogram.count(), stats.totalNs / 1e6,
+			                stats.totalNs / 1e3 / max<uint64_t>(stats.histogram.count(), 1),
+			                stats.histogram.percentile(50) / 1e3, stats.histogram.percentile(99) / 1e3,
+			                stats.maxNs / 1e3});
+		}
+		sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.totalMs > b.totalMs; });
+	}
+
+	void dump(ostream& out) const {
+		vector<Row> rows;
+		snapshot(rows);
+		unsigned long frameCount = frames();
+		out << "SQL statements over " << frameCount << " frames (times in us)" << endl;
+		out << setw(9) << "calls" << setw(11) << "per frame" << setw(11) << "total ms"
+			<< setw(10) << "mean" << setw(10) << "p50" << setw(10) << "p99" << setw(10) << "max" << "  statement" << endl;
+		for (const Row& row : rows) {
+			out << fixed << setprecision(1)
+				<< setw(9) << row.calls << setw(11) << setprecision(3) << (double) row.calls / max(frameCount, 1ul)
+				<< setw(11) << setprecision(2) << row.totalMs << setprecision(1)
+				<< setw(10) << row.meanUs << setw(10) << row.p50Us << setw(10) << row.p99Us << setw(10) << row.maxUs
+				<< "  " << *row.shape << endl;
+		}
+	}
+
+	bool writeDump(const string& path) const {
+		ofstream out(path);
+		dump(out);
+		return (bool) out;
+	}
+
+	// "... WHERE name = 'milk' AND timeStamp >= date('now', '-30 day');"
+	// -> "... WHERE name = ? AND timeStamp >= date(?, ?);"
+	static void normalize(const char *sql, string& out) {
+		out.clear();
+		for (const char *p = sql; *p; ) {
+			char c = *p;
+			if (c == '\'') {
+				// '' is an escaped quote inside the literal
+				for (++p; *p && !(p[0] == '\'' && p[1] != '\''); p += p[0] == '\'' ? 2 : 1) {}
+				p += *p ? 1 : 0;
+				out += '?';
+			} else if (isdigit((unsigned char) c) && (out.empty() || !(isIdentifier(out.back()) || out.back() == '?'))) {
+				while (isdigit((unsigned char) *p) || *p == '.') {
+					p++;
+				}
+				// A sign belongs to the number when it follows an operator
+				if (out.size() >= 2 && out.back() == '-' && !isIdentifier(out[out.size() - 2]) && out[out.size() - 2] != ')') {
+					out.pop_back();
+				}
+				out += '?';
+			} else if (isspace((unsigned char) c)) {
+				while (isspace((unsigned char) *p)) {
+					p++;
+				}
+				if (!out.empty() && *p) {
+					out += ' ';
+				}
+			} else {
+				out += c;
+				p++;
+			}
+		}
+	}
+
+private:
+	struct Shape {
+		LatencyHistogram histogram;
+		uint64_t totalNs = 0;
+		uint64_t maxNs = 0;
+	};
+
+	static bool isIdentifier(char c) {
+		return isalnum((unsigned char) c) || c == '_';
+	}
+
+	static int profile(unsigned type, void *context, void *statement, void *time) {
+		SqlTrace *trace = static_cast<SqlTrace*>(context);
+		sqlite3_stmt *stmt = static_cast<sqlite3_stmt*>(statement);
+		if (type == SQLITE_TRACE_STMT) {
+			trace->start(stmt);
+		} else if (type == SQLITE_TRACE_PROFILE) {
+			trace->record(stmt, (uint64_t) *static_cast<sqlite3_int64*>(time));
+		}
+		return 0;
+	}
+
+	void start(sqlite3_stmt *statement) {
+		lock_guard<mutex> lock(shapesMutex);
+		for (auto& [stmt, since] : running) {
+			if (stmt == statement) {
+				since = chrono::steady_clock::now();
+				return;
+			}
+		}
+		running.push_back({statement, chrono::steady_clock::now()});
+	}
+
+	void record(sqlite3_stmt *statement, uint64_t sqliteNs) {
+		const char *sql = sqlite3_sql(statement);
+		auto now = chrono::steady_clock::now();
+		auto since = now - chrono::nanoseconds(sqliteNs);
+		lock_guard<mutex> lock(shapesMutex);
+		for (size_t i = 0; i < running.size(); ++i) {
+			if (running[i].first == statement) {
+				since = running[i].second;
+				running[i] = running.back();
+				running.pop_back();
+				break;
+			}
+		}
+		if (!sql) {
+			return;
+		}
+		if (tracer.enabled()) {
+			tracer.complete("sql", sql, since, now);
+		}
+		if (!on) {
+			return;
+		}
+		uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(now - since).count();
+		normalize(sql, scratch);
+		auto it = shapes.find(scratch);
+		if (it == shapes.end()) {
+			it = shapes.emplace(scratch, Shape()).first;
+		}
+		Shape& shape = it->second;
+		shape.histogram.record(ns);
+		shape.totalNs += ns;
+		shape.maxNs = max(shape.maxNs, ns);
+	}
+
+	bool on = false;
+	mutable mutex shapesMutex;
+	unordered_map<string, Shape> shapes;
+	vector<pair<sqlite3_stmt*, chrono::steady_clock::time_point>> running; // STMT seen, PROFILE not yet
+	string scratch;
+	unsigned long frameCount = 0;
+};
+
+SqlTrace sqlTrace;
+
+#endif // SQL_TRACE_HPP
@@ -0,0 +1,74 @@
+#ifndef STARTUP_TIMER_HPP
+#define STARTUP_TIMER_HPP
+
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+#include "trace_recorder.hpp"
+
+using namespace std;
+
+// Startup split into phases, from static initialization to the first frame
+// that shows the whole purchase list. Each mark() ends the phase that began
+// at the previous one (or at launch); finish() closes the last. Phases also
+// go to the trace recorder when it is open. Time before static
+// initialization (exec, the dynamic loader) is not seen here; bench/
+// startup_bench.cpp measures it from outside.
+class StartupTimer {
+public:
+	StartupTimer() : launch(chrono::steady_clock::now()), last(launch) {
+		phases.reserve(16);
+	}
+
+	void mark(const char *phase) {
+		auto now = chrono::steady_clock::now();
+		phases.push_back({phase, ms(now - last), ms(now - launch)});
+		if (tracer.enabled()) {
+			tracer.complete("startup", phase, last, now);
+		}
+		last = now;
+	}
+
+	void finish(const char *phase) {
+		mark(phase);
+		done = true;
+	}
+
+	bool finished() const {
+		return done;
+	}
+
+	// Milliseconds from launch to the end of the last phase
+	double total() const {
+		return phases.empty() ? 0 : phases.back().sinceLaunch;
+	}
+
+	// One line per phase: name, its milliseconds, milliseconds since launch
+	void print(ostream& out) const {
+		out << "Startup" << setw(25) << "ms" << setw(14) << "since launch" << endl;
+		for (const Phase& phase : phases) {
+			out << "  " << left << setw(22) << phase.name << right << fixed << setprecision(2)
+				<< setw(8) << phase.ms << setw(14) << phase.sinceLaunch << endl;
+		}
+	}
+
+private:
+	struct Phase {
+		const char *name;
+		double ms, sinceLaunch;
+	};
+
+	static double ms(chrono::steady_clock::duration time) {
+		return chrono::duration<double, milli>(time).count();
+	}
+
+	chrono::steady_clock::time_point launch, last;
+	vector<Phase> phases;
+	bool done = false;
+};
+
+StartupTimer startup;
+
+#endif // STARTUP_TIMER_HPP
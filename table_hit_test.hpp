@@ -0,0 +1,97 @@
+#ifndef TABLE_HIT_TEST_HPP
+#define TABLE_HIT_TEST_HPP
+
+// Row and column of a table under the mouse.
+//
+// Every row of the table has the same height and the same column ratios, so
+// the cell under a point follows from the panel layout with a division and a
+// walk over the column widths. It is worked out once per frame; the rows only
+// compare their index against the result.
+struct TableHit {
+	int row = -1;    // -1 when not over a row
+	int column = -1; // -1 when between cells
+};
+
+class TableHitTest {
+public:
+	// Construct inside the list view, before its first row is laid out.
+	// `firstRow` is the index of that row, `rowCount` how many follow.
+	TableHitTest(const struct nk_context *ctx, const float *widths, int columns, int rowHeight, int firstRow, int rowCount)
+		: input(&ctx->input), columns(columns), rowHeight(rowHeight), firstRow(firstRow), rowCount(rowCount) {
+		const struct nk_panel *layout = ctx->current->layout;
+		struct nk_vec2 spacing = ctx->style.window.spacing;
+
+		clip = layout->clip;
+		left = layout->at_x;
+		top = layout->at_y + layout->row.height - *layout->offset_y;
+		width = layout->bounds.w;
+		pitch = rowHeight + spacing.y;
+
+		// Same arithmetic as an NK_DYNAMIC row
+		float space = layout->bounds.w - (columns - 1) * spacing.x;
+		float x = left;
+		for (int i = 0; i < columns && i < maxColumns; ++i) {
+			cellLeft[i] = x;
+			cellRight[i] = x + widths[i] * space;
+			x = cellRight[i] + spacing.x;
+		}
+
+		hover = at(input->mouse.pos);
+	}
+
+	TableHit at(struct nk_vec2 pos) const {
+		TableHit hit;
+		if (!NK_INBOX(pos.x, pos.y, clip.x, clip.y, clip.w, clip.h) || pos.y < top || pos.x < left) {
+			return hit;
+		}
+
+		int offset = (int) ((pos.y - top) / pitch);
+		if (offset >= rowCount || pos.y - top - offset * pitch >= rowHeight) {
+			return hit; // below the last row or in the gap under a row
+		}
+		hit.row = firstRow + offset;
+
+		for (int i = 0; i < columns && i < maxColumns; ++i) {
+			if (pos.x >= cellLeft[i] && pos.x < cellRight[i]) {
+				hit.column = i;
+				break;
+			}
+		}
+		return hit;
+	}
+
+	const TableHit& hovered() const {
+		return hover;
+	}
+
+	// The cell a click of `button` was released over this frame, if any
+	TableHit clicked(enum nk_buttons button) const {
+		const struct nk_mouse_button& state = input->mouse.buttons[button];
+		if (!state.clicked || state.down) {
+			return TableHit();
+		}
+		return at(state.clicked_pos);
+	}
+
+	// Full width rectangle of a row, for highlights
+	struct nk_rect rowBounds(int row) const {
+		return nk_rect(left, top + (row - firstRow) * pitch, width, (float) rowHeight);
+	}
+
+private:
+	static const int maxColumns = 16;
+
+	const struct nk_input *input;
+	int columns;
+	int rowHeight;
+	int firstRow;
+	int rowCount;
+
+	struct nk_rect clip;
+	float left, top, width, pitch;
+	float cellLeft[maxColumns];
+	float cellRight[maxColumns];
+	TableHit hover;
+};
+
+#endif // TABLE_HIT_TEST_HPP
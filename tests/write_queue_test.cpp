@@ -0,0 +1,64 @@
+// Checks of the write queue, run by ctest (write_queue):
+//   - a name with a quote in it, like "Kellogg's", is stored as typed
+//   - a write SQLite rejects is dropped, and the writes after it still commit
+//   - the SQL saveUnsaved() writes out puts back the same row
+// Exits 1 if any check fails.
+
+#include "write_queue.hpp"
+
+int failures = 0;
+
+void check(bool ok, const char *what) {
+	cout << (ok ? "ok      " : "FAILED  ") << what << endl;
+	failures += !ok;
+}
+
+int countNamed(sqlite3 *db, const string& name) {
+	sqlite3_stmt *stmt;
+	int count = -1;
+	if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM purchases WHERE name = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+		sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+		if (sqlite3_step(stmt) == SQLITE_ROW) {
+			count = sqlite3_column_int(stmt, 0);
+		}
+	}
+	sqlite3_finalize(stmt);
+	return count;
+}
+
+int main() {
+	sqlite3 *db;
+	if (openDatabase(":memory:", &db)) {
+		cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
+		return 1;
+	}
+	createSchema(db);
+	runCommand(db, "CREATE TRIGGER reject BEFORE INSERT ON purchases WHEN NEW.name = 'reject me' "
+				   "BEGIN SELECT RAISE(ABORT, 'rejected'); END;");
+
+	{
+		WriteQueue writes(db);
+		shared_future<bool> quoted = writes.insert("Kellogg's", 1, 45.5, "food");
+		shared_future<bool> rejected = writes.insert("reject me", 1, 1);
+		shared_future<bool> after = writes.insert("Tea", 2, 10);
+		writes.flush();
+		check(quoted.get(), "insert of Kellogg's committed");
+		check(!rejected.get(), "rejected insert resolved false");
+		check(after.get(), "insert queued after the rejected one committed");
+		check(writes.failure() == 0, "no writes left waiting on a retry");
+	}
+	check(countNamed(db, "Kellogg's") == 1, "Kellogg's stored as typed");
+	check(countNamed(db, "Tea") == 1, "Tea stored");
+	check(countNamed(db, "reject me") == 0, "rejected row not stored");
+
+	{
+		PurchaseStatements statements(db);
+		Purchase p = {0, "Kellogg's", 1, 45.5, getTimeStamp(), "food"};
+		string sql = statements.insertSql(p);
+		check(sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK, "saved insert SQL runs");
+	}
+	check(countNamed(db, "Kellogg's") == 2, "saved insert SQL stores the name as typed");
+
+	sqlite3_close(db);
+	return failures ? 1 : 0;
+}
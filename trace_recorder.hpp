@@ -0,0 +1,274 @@
+#ifndef TRACE_RECORDER_HPP
+#define TRACE_RECORDER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Timeline recorder that writes Chrome trace-event JSON, for chrome://tracing
+// or ui.perfetto.dev.
+//
+// Every thread records into a ring of its own: the thread is the only writer
+// and flush() the only reader, so recording an event takes no lock and does
+// not allocate. A full ring drops events (and counts them) rather than wait;
+// the main loop flushes once any ring is half full, and at exit. Rings of
+// threads that have exited are drained and handed to the next new thread, so
+// short-lived threads (the per-archive queries) do not add up. While closed,
+// recording costs one relaxed load.
+class TraceRecorder {
+public:
+	TraceRecorder() : epoch(chrono::steady_clock::now()) {}
+
+	bool enabled() const {
+		return on.load(memory_order_relaxed);
+	}
+
+	// Starts recording into `path`; false if it can't be written
+	bool open(const string& path) {
+		lock_guard<mutex> lock(ringsMutex);
+		out.open(path, ios::trunc);
+		if (!out) {
+			return false;
+		}
+		out << "[";
+		first = true;
+		on.store(true, memory_order_relaxed);
+		return true;
+	}
+
+	// Label for the calling thread's track
+	void nameThread(const char *name) {
+		if (!enabled()) {
+			return;
+		}
+		Ring& ring = threadRing();
+		lock_guard<mutex> lock(ringsMutex);
+		ring.threadName = name;
+		ring.named = false;
+	}
+
+	void complete(const char *category, const char *name,
+	              chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+		Ring& ring = threadRing();
+		size_t head = ring.head.load(memory_order_relaxed);
+		if (head - ring.tail.load(memory_order_acquire) == ring.events.size()) {
+			ring.dropped.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+		Event& event = ring.events[head % ring.events.size()];
+		event.category = category;
+		event.start = start - epoch;
+		event.duration = end - start;
+		copyName(event.name, name);
+		ring.head.store(head + 1, memory_order_release);
+	}
+
+	// True once some ring is half full
+	bool needsFlush() {
+		lock_guard<mutex> lock(ringsMutex);
+		for (const unique_ptr<Ring>& ring : rings) {
+			size_t pending = ring->head.load(memory_order_acquire) - ring->tail.load(memory_order_relaxed);
+			if (pending * 2 >= ring->events.size()) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Writes out everything recorded so far; returns the number of events
+	size_t flush() {
+		lock_guard<mutex> lock(ringsMutex);
+		size_t written = 0;
+		for (unique_ptr<Ring>& ring : rings) {
+			if (ring->free) {
+				continue;
+			}
+			if (!ring->named) {
+				char line[160];
+				int n = snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+				                 ring->tid);
+				writeEvent(line, n);
+				writeEscaped(ring->threadName.c_str());
+				out << "\"}}";
+				ring->named = true;
+			}
+
+			// The owner may have exited after the last event it wrote
+			bool retired = ring->retired.load(memory_order_acquire);
+			size_t tail = ring->tail.load(memory_order_relaxed);
+			size_t head = ring->head.load(memory_order_acquire);
+			for (; tail != head; ++tail) {
+				const Event& event = ring->events[tail % ring->events.size()];
+				char line[160];
+				int n = snprintf(line, sizeof(line), "{\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":\"",
+				                 event.category, ring->tid, micros(event.start), micros(event.duration));
+				writeEvent(line, n);
+				writeEscaped(event.name);
+				out << "\"}";
+				written++;
+			}
+			ring->tail.store(tail, memory_order_release);
+			droppedTotal += ring->dropped.exchange(0, memory_order_relaxed);
+			if (retired) {
+				ring->free = true;
+			}
+		}
+		out.flush();
+		return written;
+	}
+
+	// Flushes and finishes the file; returns the events dropped for want of space
+	unsigned long close() {
+		if (!enabled()) {
+			return 0;
+		}
+		flush();
+		on.store(false, memory_order_relaxed);
+		lock_guard<mutex> lock(ringsMutex);
+		out << "\n]\n";
+		out.close();
+		return droppedTotal;
+	}
+
+private:
+	static const size_t ringEvents = 8192;
+
+	struct Event {
+		const char *category;
+		chrono::steady_clock::duration start, duration;
+		char name[120];
+	};
+
+	struct Ring {
+		vector<Event> events = vector<Event>(ringEvents);
+		atomic<size_t> head{0}; // written by the owning thread
+		atomic<size_t> tail{0}; // written by flush()
+		atomic<unsigned long> dropped{0};
+		atomic<bool> retired{false}; // the owning thread has exited
+		bool free = false;           // drained after retiring, up for reuse
+		bool named = false;          // thread_name written for this tid
+		string threadName;
+		int tid = 0;
+	};
+
+	// Hands the ring back when its thread exits
+	struct Owner {
+		Ring *ring = nullptr;
+		~Owner() {
+			if (ring) {
+				ring->retired.store(true, memory_order_release);
+			}
+		}
+	};
+
+	Ring& threadRing() {
+		static thread_local Owner owner;
+		if (!owner.ring) {
+			owner.ring = adopt();
+		}
+		return *owner.ring;
+	}
+
+	Ring* adopt() {
+		lock_guard<mutex> lock(ringsMutex);
+		Ring *ring = nullptr;
+		for (unique_ptr<Ring>& candidate : rings) {
+			if (candidate->free) {
+				ring = candidate.get();
+				break;
+			}
+		}
+		if (!ring) {
+			rings.push_back(make_unique<Ring>());
+			ring = rings.back().get();
+		}
+		ring->free = false;
+		ring->retired.store(false, memory_order_relaxed);
+		ring->named = false;
+		ring->tid = ++lastTid;
+		ring->threadName = "thread " + to_string(ring->tid);
+		return ring;
+	}
+
+	// Truncates on a UTF-8 character boundary
+	static void copyName(char (&to)[120], const char *from) {
+		size_t length = strlen(from);
+		if (length >= sizeof(to)) {
+			length = sizeof(to) - 1;
+			while (length > 0 && (from[length] & 0xC0) == 0x80) {
+				length--;
+			}
+		}
+		memcpy(to, from, length);
+		to[length] = 0;
+	}
+
+	double micros(chrono::steady_clock::duration time) const {
+		return chrono::duration<double, micro>(time).count();
+	}
+
+	void writeEvent(const char *line, int length) {
+		out << (first ? "\n" : ",\n");
+		out.write(line, length);
+		first = false;
+	}
+
+	void writeEscaped(const char *text) {
+		for (const char *p = text; *p; ++p) {
+			if (*p == '"' || *p == '\\') {
+				out << '\\' << *p;
+			} else if ((unsigned char) *p < 0x20) {
+				out << ' ';
+			} else {
+				out << *p;
+			}
+		}
+	}
+
+	atomic<bool> on{false};
+	chrono::steady_clock::time_point epoch;
+	mutex ringsMutex; // guards everything below; producers only take it once
+	vector<unique_ptr<Ring>> rings;
+	int lastTid = 0;
+	ofstream out;
+	bool first = true;
+	unsigned long droppedTotal = 0;
+};
+
+TraceRecorder tracer;
+
+// Records the enclosing block as one event on the calling thread:
+//   TraceSpan span("task", "Commit batch");
+class TraceSpan {
+public:
+	TraceSpan(const char *category, const char *name) : category(category), name(name), active(tracer.enabled()) {
+		if (active) {
+			start = chrono::steady_clock::now();
+		}
+	}
+
+	~TraceSpan() {
+		if (active) {
+			tracer.complete(category, name, start, chrono::steady_clock::now());
+		}
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	const char *category;
+	const char *name;
+	bool active;
+	chrono::steady_clock::time_point start;
+};
+
+#endif // TRACE_RECORDER_HPP
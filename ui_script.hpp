@@ -0,0 +1,134 @@
+#ifndef UI_SCRIPT_HPP
+#define UI_SCRIPT_HPP
+
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// The workload --headless runs when not given a recording: a fixed sequence
+// of input frames at 60 frames per second that idles, scrolls the table down
+// and back up, selects rows, a name and a type, adds items through the form
+// and deletes a row. It feeds the glfw.input hook the same way InputReplay
+// does, and is built up front so playing it never allocates.
+//
+// Positions are those of the 1300x700 layout in main.cpp. The form is
+// filled in with Tab rather than clicks, since the name suggestions shift
+// the rows below the name field.
+class UiScript {
+public:
+	UiScript() {
+		memset(state.key_events, -1, sizeof(state.key_events));
+		state.delta_time = 1 / 60.0f;
+		move(375, 350);
+
+		idle(30);
+		scroll(-1, 120);
+		for (int row = 0; row < 8; ++row) {
+			click(200, 100 + row * 50, NK_BUTTON_LEFT);
+			idle(5);
+		}
+		click(90, 150, NK_BUTTON_RIGHT); // everything with this name
+		idle(10);
+		click(230, 200, NK_BUTTON_RIGHT); // and this type
+		idle(10);
+		scroll(1, 120);
+
+		const char *items[][4] = {
+			{"Bench coffee", "Drinks", "2", "90"},
+			{"Bench bread", "Food", "3", "45"},
+			{"Bench soap", "Household", "1", "60"},
+		};
+		for (const auto& item : items) {
+			// Clicking the name field also brings the form's window to the
+			// front, which it has to be to get the typing
+			click(1150, 451, NK_BUTTON_LEFT);
+			for (int i = 0; i < 4; ++i) {
+				if (i > 0) {
+					key(NK_KEY_TAB);
+				}
+				type(item[i]);
+			}
+			click(1025, 565, NK_BUTTON_LEFT); // Add Item
+			idle(20);
+		}
+		click(200, 74, NK_BUTTON_LEFT); // the top row
+		idle(5);
+		click(1025, 370, NK_BUTTON_LEFT); // Delete Selected
+		idle(30);
+	}
+
+	bool done() const {
+		return pos >= script.size();
+	}
+
+	void next(struct nk_glfw_input& in) {
+		if (!done()) {
+			in = script[pos++];
+		}
+	}
+
+	unsigned long frames() const {
+		return script.size();
+	}
+
+private:
+	// Frames are added with the current cursor and buttons and no events
+	void frame() {
+		script.push_back(state);
+		state.scroll = nk_vec2(0, 0);
+		state.text_len = 0;
+		memset(state.key_events, -1, sizeof(state.key_events));
+	}
+
+	void idle(int frames) {
+		for (int i = 0; i < frames; ++i) {
+			frame();
+		}
+	}
+
+	void move(int x, int y) {
+		state.x = x;
+		state.y = y;
+	}
+
+	void scroll(float delta, int frames) {
+		move(375, 350);
+		for (int i = 0; i < frames; ++i) {
+			state.scroll = nk_vec2(0, delta);
+			frame();
+		}
+	}
+
+	// Hover for a frame, press, release
+	void click(int x, int y, enum nk_buttons button) {
+		move(x, y);
+		frame();
+		state.buttons = 1 << button;
+		frame();
+		state.buttons = 0;
+		frame();
+	}
+
+	// One character a frame, like typing
+	void type(const char *text) {
+		for (const char *c = text; *c; ++c) {
+			state.text[0] = (unsigned char) *c;
+			state.text_len = 1;
+			frame();
+		}
+	}
+
+	void key(enum nk_keys key) {
+		state.key_events[key] = 1;
+		frame();
+		state.key_events[key] = 0;
+		frame();
+	}
+
+	struct nk_glfw_input state = {};
+	vector<struct nk_glfw_input> script;
+	size_t pos = 0;
+};
+
+#endif // UI_SCRIPT_HPP
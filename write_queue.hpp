@@ -0,0 +1,488 @@
+#ifndef WRITE_QUEUE_HPP
+#define WRITE_QUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "helpers.hpp"
+
+// Write-behind queue for insert() and deletePurchase().
+//
+// Writes are collected for `window` (or until `maxBatch` of them are queued)
+// and committed by a background thread in a single transaction, so a burst of
+// data entry costs one fsync instead of one per row. Every write hands back a
+// future that becomes true once the row is durable (false if it was dropped).
+// loadPurchases() overlays the writes that are still pending, so the UI shows
+// them right away.
+//
+// A batch that fails to commit (disk full, I/O error) is not dropped: it goes
+// back to the front of the queue and is tried again with a growing delay,
+// while failure() tells the UI. Whatever still fails at shutdown is written
+// out as SQL next to the database (see saveUnsaved()). A single write that
+// SQLite rejects outright (a constraint, say) would fail every retry, so that
+// one is dropped and its future becomes false.
+class WriteQueue {
+public:
+	WriteQueue(sqlite3 *db, chrono::milliseconds window = chrono::milliseconds(5), size_t maxBatch = 64)
+		: db(db), window(window), maxBatch(maxBatch) {
+		writer = thread(&WriteQueue::run, this);
+	}
+
+	~WriteQueue() {
+		{
+			lock_guard<mutex> lock(queueMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		writer.join();
+	}
+
+	WriteQueue(const WriteQueue&) = delete;
+	WriteQueue& operator=(const WriteQueue&) = delete;
+
+	// Runs f(db) while no batch transaction is open, so it never sees half a
+	// batch; combined with pending() that gives a consistent view
+	template <typename F>
+	auto read(F f) {
+		lock_guard<mutex> dbLock(dbMutex);
+		return f(db);
+	}
+
+	shared_future<bool> insert(string name, double quantity, double price, string type = "") {
+		PendingWrite write;
+		write.kind = PendingWrite::Kind::Insert;
+		write.purchase.name = name;
+		write.purchase.quantity = quantity;
+		write.purchase.price = price;
+		write.purchase.timeStamp = getTimeStamp();
+
+		{
+			lock_guard<mutex> lock(queueMutex);
+			// A pending insert of the same name decides the default type too
+			if (type.empty()) {
+				type = pendingType(name);
+			}
+		}
+		write.purchase.type = read([&](sqlite3 *db) { return resolveType(db, name, type); });
+
+		lock_guard<mutex> lock(queueMutex);
+		write.purchase.id = nextProvisionalId--;
+		return enqueue(write);
+	}
+
+	shared_future<bool> deletePurchase(int id) {
+		PendingWrite write;
+		write.kind = PendingWrite::Kind::Delete;
+		write.purchase.id = id;
+
+		lock_guard<mutex> lock(queueMutex);
+
+		// Deleting a row that never reached the database just drops its insert
+		if (id < 0) {
+			auto it = find_if(queue.begin(), queue.end(), [id](const PendingWrite& w) {
+				return w.kind == PendingWrite::Kind::Insert && w.purchase.id == id;
+			});
+			if (it != queue.end()) {
+				it->done->set_value(false);
+				queue.erase(it);
+				changes++;
+
+				promise<bool> dropped;
+				dropped.set_value(true);
+				return dropped.get_future().share();
+			}
+		}
+
+		return enqueue(write);
+	}
+
+	// Blocks until everything queued so far is committed (or, if it keeps
+	// failing, saved aside at shutdown)
+	void flush() {
+		shared_future<bool> last;
+		{
+			lock_guard<mutex> lock(queueMutex);
+			if (!queue.empty()) {
+				last = queue.back().future;
+			} else if (!inFlight.empty()) {
+				last = inFlight.back().future;
+			} else {
+				return;
+			}
+			flushRequested = true;
+		}
+		wake.notify_all();
+		last.wait();
+	}
+
+	// Writes not yet visible in the database, as of now
+	struct Overlay {
+		vector<Purchase> inserted; // newest first
+		vector<int> deleted;
+
+		bool isDeleted(const Purchase& p) const {
+			return find(deleted.begin(), deleted.end(), p.id) != deleted.end();
+		}
+	};
+
+	Overlay pending() {
+		lock_guard<mutex> lock(queueMutex);
+		Overlay overlay;
+		for (const vector<PendingWrite>* writes : {&inFlight, &queue}) {
+			for (const PendingWrite& w : *writes) {
+				if (w.kind == PendingWrite::Kind::Insert) {
+					overlay.inserted.push_back(w.purchase);
+				} else {
+					overlay.deleted.push_back(realId(w.purchase.id));
+					overlay.deleted.push_back(w.purchase.id);
+				}
+			}
+		}
+
+		auto isDeleted = [&overlay](const Purchase& p) { return overlay.isDeleted(p); };
+		overlay.inserted.erase(remove_if(overlay.inserted.begin(), overlay.inserted.end(), isDeleted), overlay.inserted.end());
+		reverse(overlay.inserted.begin(), overlay.inserted.end());
+		return overlay;
+	}
+
+	// Rows as the user sees them: the database plus the writes still queued
+	vector<Purchase> loadPurchases() {
+		return read([this](sqlite3 *db) {
+			vector<Purchase> purchases = ::loadPurchases(db);
+			Overlay overlay = pending();
+
+			auto isDeleted = [&overlay](const Purchase& p) { return overlay.isDeleted(p); };
+			purchases.erase(remove_if(purchases.begin(), purchases.end(), isDeleted), purchases.end());
+			purchases.insert(purchases.begin(), overlay.inserted.begin(), overlay.inserted.end());
+			return purchases;
+		});
+	}
+
+	// Name autocomplete over the same view: the database's names plus those
+	// of inserts still queued, ordered and limited as getNameSuggestions()
+	vector<string> nameSuggestions(const string& prefix, int limit = 5) {
+		return read([&](sqlite3 *db) {
+			vector<string> names = getNameSuggestions(db, prefix, limit);
+			if (prefix.empty()) {
+				return names;
+			}
+
+			auto lower = [](string s) {
+				transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return tolower(c); });
+				return s;
+			};
+			string lowerPrefix = lower(prefix);
+			for (const Purchase& p : pending().inserted) {
+				if (lower(p.name).compare(0, lowerPrefix.size(), lowerPrefix) == 0 &&
+					find(names.begin(), names.end(), p.name) == names.end()) {
+					names.push_back(p.name);
+				}
+			}
+			stable_sort(names.begin(), names.end(), [&](const string& a, const string& b) { return lower(a) < lower(b); });
+			if ((int) names.size() > limit) {
+				names.resize(limit);
+			}
+			return names;
+		});
+	}
+
+	// Called on the writer thread after every commit, e.g. to wake the UI
+	void setCommitListener(function<void()> listener) {
+		lock_guard<mutex> lock(queueMutex);
+		onCommit = listener;
+	}
+
+	// Bumped whenever the visible data changes (write queued or committed)
+	unsigned long version() const {
+		return changes.load();
+	}
+
+	// How many writes are waiting on a retry after a failed commit (0 while
+	// commits succeed), and the error that failed the last attempt
+	size_t failure(string *error = nullptr) {
+		lock_guard<mutex> lock(queueMutex);
+		if (lastError.empty()) {
+			return 0;
+		}
+		if (error) {
+			*error = lastError;
+		}
+		return queue.size() + inFlight.size();
+	}
+
+private:
+	struct PendingWrite {
+		enum class Kind { Insert, Delete } kind;
+		Purchase purchase; // Delete only uses the id
+		shared_ptr<promise<bool>> done;
+		shared_future<bool> future;
+	};
+
+	shared_future<bool> enqueue(PendingWrite& write) {
+		write.done = make_shared<promise<bool>>();
+		write.future = write.done->get_future().share();
+		queue.push_back(write);
+		changes++;
+		if (queue.size() == 1 || queue.size() >= maxBatch) {
+			wake.notify_all();
+		}
+		return write.future;
+	}
+
+	string pendingType(const string& name) const {
+		for (const vector<PendingWrite>* pending : {&queue, &inFlight}) {
+			for (auto it = pending->rbegin(); it != pending->rend(); ++it) {
+				if (it->kind == PendingWrite::Kind::Insert && it->purchase.name == name) {
+					return it->purchase.type;
+				}
+			}
+		}
+		return "";
+	}
+
+	int realId(int id) const {
+		auto it = committedIds.find(id);
+		return it == committedIds.end() ? id : it->second;
+	}
+
+	// Only rows still on screen with their provisional id need mapping, and
+	// the list reloads after every commit; the oldest ids (closest to zero)
+	// go first
+	void rememberIds(const map<int, int>& ids) {
+		committedIds.insert(ids.begin(), ids.end());
+		while (committedIds.size() > maxCommittedIds) {
+			committedIds.erase(prev(committedIds.end()));
+		}
+	}
+
+	void run() {
+		tracer.nameThread("writer");
+		unique_lock<mutex> lock(queueMutex);
+		while (true) {
+			wake.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (queue.empty()) {
+				break;
+			}
+
+			// After a failed commit, wait before trying the same writes again;
+			// shutting down gets one last attempt straight away
+			if (!lastError.empty()) {
+				wake.wait_until(lock, retryAt, [this] { return stopping; });
+			}
+
+			// Let the batch fill up for one window
+			auto deadline = chrono::steady_clock::now() + window;
+			wake.wait_until(lock, deadline, [this] {
+				return stopping || flushRequested || queue.size() >= maxBatch;
+			});
+			flushRequested = false;
+
+			inFlight.swap(queue);
+			lock.unlock();
+			bool committed = commit();
+			lock.lock();
+			if (!committed && stopping) {
+				saveUnsaved();
+				break;
+			}
+		}
+	}
+
+	bool commit() {
+		TraceSpan span("task", "Commit batch");
+		vector<PendingWrite> batch;
+		map<int, int> ids;
+		function<void()> listener;
+		string error;
+		size_t failed;
+		// Another process holding the write lock is not an error: roll back
+		// and try the whole batch again once it has let go. The database lock
+		// is held for one attempt at a time, in which SQLite waits at most
+		// writeLockWaitMs for the write lock, and released during the backoff,
+		// so reads on the UI thread never queue behind a locked database.
+		auto attempt = [&] {
+			lock_guard<mutex> dbLock(dbMutex);
+			sqlite3_busy_timeout(db, writeLockWaitMs);
+			ids.clear();
+			int result = writeBatch(ids, failed);
+			if (result != SQLITE_OK) {
+				error = sqlite3_errmsg(db); // before ROLLBACK replaces it
+				sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+			}
+			sqlite3_busy_timeout(db, busyTimeoutMs);
+
+			// Still under the database lock, so no reader sees these rows
+			// both committed and pending
+			if (result == SQLITE_OK) {
+				lock_guard<mutex> lock(queueMutex);
+				rememberIds(ids);
+				batch.swap(inFlight);
+				changes++;
+				lastError.clear();
+				retryDelay = firstRetryDelay;
+			}
+			return result;
+		};
+		int rc;
+		while (true) {
+			rc = retryBusy(attempt, 12); // about a second of backoff before the UI hears of it
+
+			// The rest of the batch goes again straight away without the
+			// write that was rejected
+			if (rc == SQLITE_OK || isBusy(rc) || failed >= inFlight.size()) {
+				break;
+			}
+			lock_guard<mutex> lock(queueMutex);
+			cerr << "SQL error: " << error << "; write dropped" << endl;
+			inFlight[failed].done->set_value(false);
+			inFlight.erase(inFlight.begin() + (ptrdiff_t) failed);
+			changes++;
+		}
+
+		{
+			lock_guard<mutex> lock(queueMutex);
+			if (rc != SQLITE_OK) {
+				// Nothing visible changes: the writes stay pending, in order
+				lastError = error;
+				cerr << "SQL error: " << lastError << "; " << inFlight.size() << " writes kept for a retry" << endl;
+				queue.insert(queue.begin(), make_move_iterator(inFlight.begin()), make_move_iterator(inFlight.end()));
+				inFlight.clear();
+				retryAt = chrono::steady_clock::now() + retryDelay;
+				retryDelay = min(retryDelay * 2, lastRetryDelay);
+			}
+			listener = onCommit;
+		}
+
+		for (PendingWrite& w : batch) {
+			w.done->set_value(true);
+		}
+		if (listener) {
+			listener();
+		}
+		return rc == SQLITE_OK;
+	}
+
+	// Shutting down with writes that still fail: their SQL goes to
+	// <database>.unsaved.sql, to be applied once the disk is fixed with
+	// `sqlite3 data.db < data.db.unsaved.sql`. Called with queueMutex held.
+	void saveUnsaved() {
+		const char *dbFile = sqlite3_db_filename(db, "main");
+		string path = string(dbFile && *dbFile ? dbFile : "data.db") + ".unsaved.sql";
+
+		// An insert deleted again before it was saved cancels out
+		vector<int> deleted;
+		for (const PendingWrite& w : queue) {
+			if (w.kind == PendingWrite::Kind::Delete) {
+				deleted.push_back(realId(w.purchase.id));
+			}
+		}
+
+		ofstream out(path, ios::app);
+		out << "BEGIN;\n";
+		for (const PendingWrite& w : queue) {
+			const Purchase& p = w.purchase;
+			if (w.kind == PendingWrite::Kind::Insert) {
+				if (find(deleted.begin(), deleted.end(), p.id) == deleted.end()) {
+					out << statements().insertSql(p) << "\n";
+				}
+			} else if (realId(p.id) > 0) {
+				out << statements().removeSql(realId(p.id)) << "\n";
+			}
+		}
+		out << "COMMIT;\n";
+		out.close();
+		if (out) {
+			cerr << queue.size() << " writes could not be saved (" << lastError << "); their SQL is in " << path << endl;
+		} else {
+			cerr << queue.size() << " writes could not be saved (" << lastError << "), nor written to " << path << endl;
+		}
+
+		for (PendingWrite& w : queue) {
+			w.done->set_value(false);
+		}
+		queue.clear();
+	}
+
+	// Prepared on first use, on the writer thread, which is the only one to
+	// use them
+	PurchaseStatements& statements() {
+		if (!purchaseStatements) {
+			purchaseStatements = make_unique<PurchaseStatements>(db);
+		}
+		return *purchaseStatements;
+	}
+
+	// `failed` is set to the index in inFlight of the write that failed, or
+	// past the end if it was the transaction itself
+	int writeBatch(map<int, int>& ids, size_t& failed) {
+		failed = inFlight.size();
+		// IMMEDIATE takes the write lock up front, so the transaction cannot
+		// deadlock half way through against another writer
+		int rc = sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+		for (size_t i = 0; i < inFlight.size() && rc == SQLITE_OK; ++i) {
+			const PendingWrite& w = inFlight[i];
+			if (w.kind == PendingWrite::Kind::Insert) {
+				const Purchase& p = w.purchase;
+				rc = statements().insert(p);
+				ids[p.id] = (int) sqlite3_last_insert_rowid(db);
+			} else {
+				int id = w.purchase.id;
+				if (ids.count(id)) {
+					id = ids[id];
+				} else {
+					lock_guard<mutex> lock(queueMutex);
+					id = realId(id);
+				}
+				// Still provisional: its insert was dropped
+				if (id < 0) {
+					continue;
+				}
+				rc = statements().remove(id);
+			}
+			if (rc != SQLITE_OK) {
+				failed = i;
+			}
+		}
+		if (rc != SQLITE_OK) {
+			return rc;
+		}
+		return sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+	}
+
+	sqlite3 *db;
+	chrono::milliseconds window;
+	size_t maxBatch;
+
+	static constexpr int writeLockWaitMs = 4; // per attempt, while holding dbMutex
+
+	mutex dbMutex;       // held while a batch transaction is open
+	mutex queueMutex;    // guards everything below
+	condition_variable wake;
+	vector<PendingWrite> queue;
+	vector<PendingWrite> inFlight;
+	map<int, int> committedIds; // provisional id -> rowid, the most recent only
+	static constexpr size_t maxCommittedIds = 1024;
+	int nextProvisionalId = -1;
+	string lastError; // why the last commit failed; empty once one succeeds
+	chrono::steady_clock::time_point retryAt;
+	static constexpr chrono::milliseconds firstRetryDelay{500}, lastRetryDelay{30000};
+	chrono::milliseconds retryDelay = firstRetryDelay;
+	bool flushRequested = false;
+	bool stopping = false;
+	atomic<unsigned long> changes{0};
+	function<void()> onCommit;
+	unique_ptr<PurchaseStatements> purchaseStatements;
+
+	thread writer;
+};
+
+#endif // WRITE_QUEUE_HPP